@@ -0,0 +1,126 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Precision dependent analyzer code, included by wav-analyzer.c once per
+ * precision with:
+ * - SAMPLE_T: the type of the samples
+ * - POWER_T: the type of the power distribution
+ * - SAMPLE_FN(): suffixes names with the precision, which also gives the
+ *   name of the matching hot loops in the kernels table (see wav-kernels.h)
+ * - SAMPLE_SCALE(): derives the conversion scale of the raw samples
+ * - SAMPLE_FROM_DOUBLE(), SAMPLE_TO_DOUBLE(): conversions from/to [-1; 1]
+ * - POWER_HALF(): halves the magnitude corresponding to a power value
+ * - POWER_TO_MAG(): converts a power value into the magnitude the double
+ *   precision FFT would have given
+ */
+
+/* Convert raw samples into SAMPLE_T and return their peak amplitude */
+static double SAMPLE_FN(convert)(void *wave, const int32_t *raw, unsigned int n,
+				 const struct audio *wav)
+{
+	return SAMPLE_TO_DOUBLE(kernels->SAMPLE_FN(convert)(wave, raw,
+							    SAMPLE_SCALE(wav), n));
+}
+
+static void SAMPLE_FN(fill_hann)(void *data, unsigned int size)
+{
+	SAMPLE_T *hann = data;
+	unsigned int i;
+
+	for (i = 0; i < size; i++)
+		hann[i] = SAMPLE_FROM_DOUBLE(hann_window(1.0, i, size));
+}
+
+/* Hann-window a signal into a lane of the batch */
+static void SAMPLE_FN(window)(void *data, const void *wave, const void *hann,
+			      unsigned int lane, unsigned int size)
+{
+	SAMPLE_T *lanes = data;
+
+	kernels->SAMPLE_FN(window)(&lanes[lane], wave, hann, size);
+}
+
+static void SAMPLE_FN(zero_lane)(void *data, unsigned int lane,
+				 unsigned int size)
+{
+	SAMPLE_T *lanes = data;
+	unsigned int i;
+
+	for (i = 0; i < size; i++)
+		lanes[i * FFT_LANES + lane] = 0;
+}
+
+static void SAMPLE_FN(power)(void *power, const void *re, const void *im,
+			     unsigned int size)
+{
+	kernels->SAMPLE_FN(power)(power, re, im, size);
+}
+
+/* Extract the major frequencies out of the power distribution of a signal
+ * of the batch by:
+ * - Deriving a threshold as being half of the maximum power
+ * - Finding a maximum each time the power distribution crosses the threshold
+ * - Listing these maxima as being the relevant frequencies for our analysis
+ * Implementation inspired from igt-gpu-tools, see COPYING.
+ */
+static void SAMPLE_FN(find_frequencies)(unsigned int *freqs,
+					unsigned int *nfreqs,
+					const void *data, unsigned int signal,
+					unsigned int size, double *max_thresh,
+					const struct audio *wav)
+{
+	const POWER_T *power = (const POWER_T *)data +
+			       (signal % 2) * FFT_LANES + signal / 2;
+	size_t power_len = size / 2 + 1;
+	POWER_T local_max = 0, maximum, threshold;
+	unsigned int local_max_idx = 0, i;
+	unsigned int frequency;
+	bool above = false;
+
+	/* Find maximum power, derive a threshold above which we will consider a
+	 * peak and save the maximum threshold used on the channel to let the
+	 * user know about the amount of possible noise.
+	 */
+	maximum = 0;
+	for (i = (MIN_FREQ * size / wav->sample_rate); i < power_len - 1; i++) {
+		if (POWER_AT(power, i) > maximum)
+			maximum = POWER_AT(power, i);
+	}
+
+	threshold = POWER_HALF(maximum);
+	if (POWER_TO_MAG(threshold, size) < POWER_NOISE_LEVEL)
+		return;
+
+	if (POWER_TO_MAG(threshold, size) > *max_thresh)
+		*max_thresh = POWER_TO_MAG(threshold, size);
+
+	/* Read peaks in the range [FREQ_MIN; Fs/2[ */
+	for (i = (MIN_FREQ * size / wav->sample_rate); i < power_len - 1; i++) {
+		if (POWER_AT(power, i) > threshold) {
+			/* We are looking for a max */
+			above = true;
+			if (POWER_AT(power, i) > local_max) {
+				local_max = POWER_AT(power, i);
+				local_max_idx = i;
+			}
+		} else {
+			if (above) {
+				/* We found a frequency */
+				frequency = wav->sample_rate * local_max_idx / size;
+				add_freq_to_list(freqs, nfreqs, frequency);
+			}
+			above = false;
+			local_max = 0;
+		}
+	}
+}
+
+static const struct precision_ops SAMPLE_FN(ops) = {
+	.sample_size = sizeof(SAMPLE_T),
+	.power_size = sizeof(POWER_T),
+	.convert = SAMPLE_FN(convert),
+	.fill_hann = SAMPLE_FN(fill_hann),
+	.window = SAMPLE_FN(window),
+	.zero_lane = SAMPLE_FN(zero_lane),
+	.power = SAMPLE_FN(power),
+	.find_frequencies = SAMPLE_FN(find_frequencies),
+};
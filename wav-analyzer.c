@@ -12,15 +12,129 @@
 #include <stdbool.h>
 #include <string.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <math.h>
-#include <gsl/gsl_fft_real.h>
+#include <signal.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
 
 #include "wav-lib.h"
+#include "wav-fft.h"
+#include "wav-kernels.h"
+#include "wav-input.h"
+#include "wav-socket.h"
+#include "wav-pool.h"
+#include "wav-stats.h"
 
 #define MAX_FREQS_PER_CHAN 64
 #define POWER_NOISE_LEVEL 5.0 /* Arbitrary Unit */
 #define FREQ_ACCURACY 1 /* Hz */
 
+#ifndef DEFAULT_PRECISION
+#define DEFAULT_PRECISION "double"
+#endif
+
+struct analyzer_opts {
+	unsigned int gate_db;
+	enum precision precision;
+	unsigned int jobs;
+	/* Time range to analyze, in seconds, the whole data by default */
+	unsigned int start_s;
+	unsigned int length_s;
+	bool follow;
+	/* Unix sockets of the daemon */
+	const char *daemon;
+	const char *connect;
+	/* Spool directory of the captures to analyze */
+	const char *watch;
+	/* Campaign of files split in shards, or partial results to merge */
+	const char *manifest;
+	unsigned int shard;
+	unsigned int nshards;
+	bool merge;
+	enum stats_format stats;
+	const char *trace;
+	bool perf_counters;
+	/* Memory available to each analysis, in MiB, unlimited if 0 */
+	unsigned int mem_limit;
+	/* Workers analyzing the ranges of the windows, threads otherwise */
+	struct pool *pool;
+	/* Input given as a descriptor, eg. a memfd, instead of a path */
+	int fd;
+	/* Input files, the first one being the path */
+	const char *path;
+	char **paths;
+	unsigned int npaths;
+	/* Format of a headerless input, if any */
+	struct wav_format raw;
+};
+
+/* Time spent in each stage of the analyses and what they processed */
+enum analyzer_stage {
+	STAGE_HEADER,
+	STAGE_READ,
+	STAGE_UNPACK,
+	STAGE_DEDUP,
+	STAGE_CONVERT,
+	STAGE_WINDOW,
+	STAGE_FFT,
+	STAGE_POWER,
+	STAGE_PEAKS,
+	STAGE_REPORT,
+	NSTAGES,
+};
+
+enum analyzer_counter {
+	COUNTER_BYTES,
+	COUNTER_WINDOWS,
+	COUNTER_GATED,
+	COUNTER_FFTS,
+	COUNTER_PEAKS,
+	NCOUNTERS,
+};
+
+static struct stats_entry stages[NSTAGES] = {
+	[STAGE_HEADER] = { .name = "header" },
+	[STAGE_READ] = { .name = "read" },
+	[STAGE_UNPACK] = { .name = "deinterleave" },
+	[STAGE_DEDUP] = { .name = "duplicates" },
+	[STAGE_CONVERT] = { .name = "convert" },
+	[STAGE_WINDOW] = { .name = "window" },
+	[STAGE_FFT] = { .name = "fft" },
+	[STAGE_POWER] = { .name = "power" },
+	[STAGE_PEAKS] = { .name = "peaks" },
+	[STAGE_REPORT] = { .name = "report" },
+};
+
+static struct stats_entry counters[NCOUNTERS] = {
+	[COUNTER_BYTES] = { .name = "bytes" },
+	[COUNTER_WINDOWS] = { .name = "windows" },
+	[COUNTER_GATED] = { .name = "gated" },
+	[COUNTER_FFTS] = { .name = "ffts" },
+	[COUNTER_PEAKS] = { .name = "peaks" },
+};
+
+static struct stats stats = {
+	.stages = stages,
+	.nstages = NSTAGES,
+	.counters = counters,
+	.ncounters = NCOUNTERS,
+};
+
+/* Sliding window geometry, the signal is split in blocks of 'slide' samples
+ * starting at 'offset', each window spans two consecutive blocks.
+ */
+struct windows {
+	unsigned int offset;
+	unsigned int slide;
+	unsigned int size;
+};
+
 /* Find the next power of 2, useful for performing FFT calculations */
 static uint32_t next_pow_2(unsigned int val)
 {
@@ -45,7 +159,7 @@ static bool freqs_are_equal(unsigned int f1, unsigned int f2, unsigned int accur
 	return false;
 }
 
-static bool freq_is_listed(unsigned int *freqs, unsigned int nfreqs,
+static bool freq_is_listed(const unsigned int *freqs, unsigned int nfreqs,
 			   unsigned int frequency)
 {
 	unsigned int i;
@@ -65,7 +179,7 @@ static void add_freq_to_list(unsigned int *freqs, unsigned int *nfreqs,
 			     unsigned int frequency)
 {
 	if (*nfreqs + 1 >= MAX_FREQS_PER_CHAN) {
-		fprintf(stderr, "Maximum number of detected frequencies reached\n");
+		fprintf(diag(), "Maximum number of detected frequencies reached\n");
 		return;
 	}
 
@@ -84,135 +198,457 @@ static double hann_window(double val, unsigned int idx, unsigned int len)
 	return val * 0.5 * (1 - cos(2.0 * M_PI * (double) idx / (double) len));
 }
 
-/* Extract the major frequencies by:
- * - Windowing the data set
- * - Performing a discrete FFT
- * - Generating a power distribution across the frequencies
- * - Deriving a threshold as being half of the maximum power
- * - Finding a maximum each time the power distribution crosses the threshold
- * - Listing these maxima as being the relevant frequencies for our analysis
- * Implementation inspired from igt-gpu-tools, see COPYING.
+/* Full scale value of the samples */
+static double sample_factor(const struct audio *wav)
+{
+	switch (wav->bits_per_sample) {
+	case 16:
+		return INT16_MAX;
+	case 24:
+		return 0x7FFFFF;
+	case 32:
+		return INT32_MAX;
+	default:
+		return 0;
+	};
+}
+
+/* Channel hashes are made of HASH_LANES interleaved xxHash64 accumulators
+ * (sample s going to lane s % HASH_LANES), merged at the end.
  */
-static void extract_frequencies(unsigned int *freqs, unsigned int *nfreqs,
-				double *wave, unsigned int size,
-				double *max_thresh, const struct audio *wav)
+#define HASH_PRIME1 0x9E3779B185EBCA87ULL
+#define HASH_PRIME2 0xC2B2AE3D27D4EB4FULL
+#define HASH_LANES 4
+
+static uint64_t hash_round(uint64_t hash, uint64_t input)
 {
-	size_t power_len = size / 2 + 1;
-	double data[size], power[power_len], local_max = 0, maximum, threshold;
-	unsigned int local_max_idx = 0, i;
-	unsigned int frequency;
-	bool above = false;
+	hash += input * HASH_PRIME2;
+	hash = (hash << 31) | (hash >> 33);
 
-	/* Don't smash the wave, GSL functions work in-place */
-	memcpy(data, wave, size * sizeof(double));
+	return hash * HASH_PRIME1;
+}
 
-	/* Hann-window the signal to limit harmonics on discontinuous segments */
-	for (i = 0; i < size; i++)
-		data[i] = hann_window(data[i], i, size);
+static void hash_init(uint64_t *hash)
+{
+	unsigned int l;
 
-	/* Perform Discrete FFT in-place */
-	if (gsl_fft_real_radix2_transform(data, 1, size))
-		return;
+	for (l = 0; l < HASH_LANES; l++)
+		hash[l] = HASH_PRIME1 + l;
+}
 
-	/* Extract the computed power out of the real and imaginary parts:
-	 * http://linux.math.tifr.res.in/manuals/html/gsl-ref-html/gsl-ref_15.html#SEC240
-	 */
-	power[0] = data[0];
-	for (i = 1; i < power_len - 1; i++)
-		power[i] = hypot(data[i], data[size - i]);
-	power[power_len - 1] = data[size / 2];
-
-	/* Find maximum power, derive a threshold above which we will consider a
-	 * peak and save the maximum threshold used on the channel to let the
-	 * user know about the amount of possible noise.
+/* Accumulate n samples, the first one being the sample number first */
+static void hash_block(uint64_t *hash, const int32_t *raw, unsigned int first,
+		       unsigned int n)
+{
+	unsigned int s;
+
+	for (s = 0; s < n; s++)
+		hash[(first + s) % HASH_LANES] =
+			hash_round(hash[(first + s) % HASH_LANES],
+				   (uint32_t)raw[s]);
+}
+
+static uint64_t hash_final(const uint64_t *hash)
+{
+	uint64_t h = 0;
+	unsigned int l;
+
+	for (l = 0; l < HASH_LANES; l++)
+		h = hash_round(h, hash[l]);
+
+	return h;
+}
+
+/* Analysis kernels depending on the precision of the samples */
+struct precision_ops {
+	size_t sample_size;
+	size_t power_size;
+	double (*convert)(void *wave, const int32_t *raw, unsigned int n,
+			  const struct audio *wav);
+	void (*fill_hann)(void *hann, unsigned int size);
+	void (*window)(void *lanes, const void *wave, const void *hann,
+		       unsigned int lane, unsigned int size);
+	void (*zero_lane)(void *lanes, unsigned int lane, unsigned int size);
+	void (*power)(void *power, const void *re, const void *im,
+		      unsigned int size);
+	void (*find_frequencies)(unsigned int *freqs, unsigned int *nfreqs,
+				 const void *power, unsigned int signal,
+				 unsigned int size, double *max_thresh,
+				 const struct audio *wav);
+};
+
+/* Power of a bin, the distributions of a batch being interleaved */
+#define POWER_AT(power, i) ((power)[(i) * 2 * FFT_LANES])
+
+#define SAMPLE_T double
+#define POWER_T double
+#define SAMPLE_FN(name) name##_double
+#define SAMPLE_SCALE(wav) sample_factor(wav)
+#define SAMPLE_FROM_DOUBLE(x) (x)
+#define SAMPLE_TO_DOUBLE(x) (x)
+#define POWER_HALF(p) ((p) / 2)
+#define POWER_TO_MAG(p, size) (p)
+#include "wav-analyzer-tmpl.h"
+#undef SAMPLE_T
+#undef POWER_T
+#undef SAMPLE_FN
+#undef SAMPLE_SCALE
+#undef SAMPLE_FROM_DOUBLE
+#undef SAMPLE_TO_DOUBLE
+#undef POWER_HALF
+#undef POWER_TO_MAG
+
+#define SAMPLE_T float
+#define POWER_T float
+#define SAMPLE_FN(name) name##_float
+#define SAMPLE_SCALE(wav) sample_factor(wav)
+#define SAMPLE_FROM_DOUBLE(x) (x)
+#define SAMPLE_TO_DOUBLE(x) (x)
+#define POWER_HALF(p) ((p) / 2)
+#define POWER_TO_MAG(p, size) (p)
+#include "wav-analyzer-tmpl.h"
+#undef SAMPLE_T
+#undef POWER_T
+#undef SAMPLE_FN
+#undef SAMPLE_SCALE
+#undef SAMPLE_FROM_DOUBLE
+#undef SAMPLE_TO_DOUBLE
+#undef POWER_HALF
+#undef POWER_TO_MAG
+
+/* Q31 fixed point, meant for targets without FPU: the raw samples are left
+ * aligned on 32 bits and the power distribution is a squared magnitude, so
+ * the hot paths only use integer arithmetic. The windowed samples are halved
+ * to leave some headroom to the FFT, whose output is then scaled down by
+ * 2 * size.
+ */
+#define SAMPLE_T int32_t
+#define POWER_T uint64_t
+#define SAMPLE_FN(name) name##_fixed
+#define SAMPLE_SCALE(wav) (32 - (wav)->bits_per_sample)
+#define SAMPLE_FROM_DOUBLE(x) ((int32_t)lrint((x) * INT32_MAX))
+#define SAMPLE_TO_DOUBLE(x) ((x) / 2147483648.0)
+#define POWER_HALF(p) ((p) / 4)
+#define POWER_TO_MAG(p, size) (sqrt(p) * 2 * (size) / 2147483648.0)
+#include "wav-analyzer-tmpl.h"
+#undef SAMPLE_T
+#undef POWER_T
+#undef SAMPLE_FN
+#undef SAMPLE_SCALE
+#undef SAMPLE_FROM_DOUBLE
+#undef SAMPLE_TO_DOUBLE
+#undef POWER_HALF
+#undef POWER_TO_MAG
+
+static const struct precision_ops *precision_ops(enum precision precision)
+{
+	switch (precision) {
+	case PRECISION_FLOAT:
+		return &ops_float;
+	case PRECISION_FIXED:
+		return &ops_fixed;
+	case PRECISION_DOUBLE:
+	default:
+		return &ops_double;
+	}
+}
+
+/* FFT plan and Hann window of a size and precision, shared by the batches of
+ * an analysis and kept by the daemon from one analysis to the next. The
+ * analyses running concurrently in a pool share them too, unused tables
+ * only are evicted.
+ */
+struct window_tables {
+	unsigned int size;
+	enum precision precision;
+	struct fft_plan *plan;
+	void *hann;
+	unsigned int users;
+};
+
+#define TABLES_CACHE_SIZE 8
+/* Clients served at once by the daemon, each holding one entry of the cache */
+#define DAEMON_CLIENTS TABLES_CACHE_SIZE
+
+struct tables_cache {
+	pthread_mutex_t lock;
+	struct window_tables tables[TABLES_CACHE_SIZE];
+	unsigned int ntables;
+	unsigned int next;
+};
+
+static void tables_free(struct window_tables *tables)
+{
+	fft_plan_free(tables->plan);
+	mem_free(tables->hann);
+}
+
+static const struct window_tables *tables_get(struct tables_cache *cache,
+					      unsigned int size,
+					      enum precision precision)
+{
+	const struct precision_ops *ops = precision_ops(precision);
+	struct window_tables *tables;
+	unsigned int i;
+
+	pthread_mutex_lock(&cache->lock);
+
+	for (i = 0; i < cache->ntables; i++) {
+		tables = &cache->tables[i];
+		if (tables->size == size && tables->precision == precision)
+			goto take;
+	}
+
+	/* Evict the oldest unused tables once the cache is full */
+	if (cache->ntables < TABLES_CACHE_SIZE) {
+		tables = &cache->tables[cache->ntables++];
+	} else {
+		for (i = 0; i < TABLES_CACHE_SIZE; i++) {
+			tables = &cache->tables[cache->next++ % TABLES_CACHE_SIZE];
+			if (!tables->users)
+				break;
+		}
+
+		if (i == TABLES_CACHE_SIZE) {
+			fprintf(diag(), "Too many window sizes in use\n");
+			tables = NULL;
+			goto unlock;
+		}
+
+		tables_free(tables);
+	}
+
+	tables->size = size;
+	tables->precision = precision;
+	tables->plan = fft_plan_alloc(size, precision);
+	tables->hann = mem_alloc(size * ops->sample_size);
+	if (!tables->plan || !tables->hann) {
+		tables_free(tables);
+		tables->plan = NULL;
+		tables->hann = NULL;
+		tables->size = 0;
+		tables = NULL;
+		goto unlock;
+	}
+
+	ops->fill_hann(tables->hann, size);
+
+take:
+	tables->users++;
+unlock:
+	pthread_mutex_unlock(&cache->lock);
+
+	return tables;
+}
+
+static void tables_put(struct tables_cache *cache,
+		       const struct window_tables *tables)
+{
+	pthread_mutex_lock(&cache->lock);
+	cache->tables[tables - cache->tables].users--;
+	pthread_mutex_unlock(&cache->lock);
+}
+
+static void tables_cache_cleanup(struct tables_cache *cache)
+{
+	unsigned int i;
+
+	for (i = 0; i < cache->ntables; i++)
+		tables_free(&cache->tables[i]);
+}
+
+/* Windows waiting for a batched FFT. Each complex lane of the batch carries
+ * two real signals, packed in its real and imaginary parts.
+ */
+struct window_batch {
+	const struct precision_ops *ops;
+	const struct fft_plan *plan;
+	const void *hann;
+	void *re;
+	void *im;
+	void *power;
+	unsigned int nsignals;
+	unsigned int chans[2 * FFT_LANES];
+	unsigned int windows[2 * FFT_LANES];
+	/* Where to save the results of each channel */
+	unsigned int **cfreqs;
+	unsigned int *ncfreqs;
+	double *thresholds;
+	const struct audio *wav;
+	/* Optional report of the frequencies of each window, NULL for a
+	 * gated window.
 	 */
-	maximum = 0;
-	for (i = (MIN_FREQ * size / wav->sample_rate); i < power_len - 1; i++) {
-		if (power[i] > maximum)
-			maximum = power[i];
+	void (*report)(void *priv, unsigned int chan, unsigned int window,
+		       const unsigned int *freqs, unsigned int nfreqs);
+	void *priv;
+};
+
+static void batch_cleanup(struct window_batch *batch)
+{
+	mem_free(batch->re);
+	mem_free(batch->im);
+	mem_free(batch->power);
+}
+
+static int batch_init(struct window_batch *batch,
+		      const struct window_tables *tables)
+{
+	unsigned int size = tables->size;
+	size_t sample_size;
+
+	batch->ops = precision_ops(tables->precision);
+	sample_size = batch->ops->sample_size;
+	batch->nsignals = 0;
+	batch->report = NULL;
+	batch->plan = tables->plan;
+	batch->hann = tables->hann;
+	batch->re = mem_alloc(size * FFT_LANES * sample_size);
+	batch->im = mem_alloc(size * FFT_LANES * sample_size);
+	batch->power = mem_alloc((size / 2 + 1) * 2 * FFT_LANES *
+				 batch->ops->power_size);
+	if (!batch->re || !batch->im || !batch->power) {
+		batch_cleanup(batch);
+		return -1;
 	}
 
-	threshold = maximum / 2;
-	if (threshold < POWER_NOISE_LEVEL)
+	return 0;
+}
+
+/* Extract the major frequencies of the queued windows by:
+ * - Performing a batch of discrete FFTs
+ * - Generating a power distribution across the frequencies of each window
+ * - Looking for peaks in these distributions
+ */
+static void batch_flush(struct window_batch *batch)
+{
+	const struct precision_ops *ops = batch->ops;
+	unsigned int size = batch->plan->size, s, c, i;
+	unsigned int freqs[MAX_FREQS_PER_CHAN], nfreqs;
+	uint64_t t;
+
+	if (!batch->nsignals)
 		return;
 
-	if (threshold > *max_thresh)
-		*max_thresh = threshold;
-
-	/* Read peaks in the range [FREQ_MIN; Fs/2[ */
-	for (i = (MIN_FREQ * size / wav->sample_rate); i < power_len - 1; i++) {
-		if (power[i] > threshold) {
-			/* We are looking for a max */
-			above = true;
-			if (power[i] > local_max) {
-				local_max = power[i];
-				local_max_idx = i;
-			}
-		} else {
-			if (above) {
-				/* We found a frequency */
-				frequency = wav->sample_rate * local_max_idx / size;
-				add_freq_to_list(freqs, nfreqs, frequency);
-			}
-			above = false;
-			local_max = 0.0;
+	/* Don't let a stale imaginary part pollute a lonely signal */
+	if (batch->nsignals % 2)
+		ops->zero_lane(batch->im, batch->nsignals / 2, size);
+
+	t = stats_now(&stats);
+	fft_batch_forward(batch->plan, batch->re, batch->im);
+	stats_stage(&stats, STAGE_FFT, t);
+	stats_count(&stats, COUNTER_FFTS, 1);
+
+	t = stats_now(&stats);
+	ops->power(batch->power, batch->re, batch->im, size);
+	stats_stage(&stats, STAGE_POWER, t);
+
+	t = stats_now(&stats);
+	for (s = 0; s < batch->nsignals; s++) {
+		c = batch->chans[s];
+		if (!batch->report) {
+			nfreqs = batch->ncfreqs[c];
+			ops->find_frequencies(batch->cfreqs[c], &batch->ncfreqs[c],
+					      batch->power, s, size,
+					      &batch->thresholds[c], batch->wav);
+			stats_count(&stats, COUNTER_PEAKS,
+				    batch->ncfreqs[c] - nfreqs);
+			continue;
 		}
+
+		/* Report the window alone before adding it to the channel */
+		nfreqs = 0;
+		ops->find_frequencies(freqs, &nfreqs, batch->power, s, size,
+				      &batch->thresholds[c], batch->wav);
+		stats_count(&stats, COUNTER_PEAKS, nfreqs);
+		batch->report(batch->priv, c, batch->windows[s], freqs, nfreqs);
+		for (i = 0; i < nfreqs; i++)
+			add_freq_to_list(batch->cfreqs[c], &batch->ncfreqs[c],
+					 freqs[i]);
 	}
+	stats_stage(&stats, STAGE_PEAKS, t);
+
+	batch->nsignals = 0;
 }
 
-static double get_sample(uint8_t *buf, unsigned int chan,
-			 unsigned int sample, const struct audio *wav)
+/* Hann-window a signal to limit harmonics on discontinuous segments and queue
+ * it in the next free half lane.
+ */
+static void batch_push(struct window_batch *batch, const void *wave,
+		       unsigned int chan, unsigned int window)
 {
-	int16_t *buf_i16 = (int16_t *)buf;
-	int24_t *buf_i24 = (int24_t *)buf;
-	int32_t *buf_i32 = (int32_t *)buf;
+	void *lanes = batch->nsignals % 2 ? batch->im : batch->re;
+	uint64_t t = stats_now(&stats);
 
-	switch (wav->bits_per_sample) {
-	case 16:
-		return buf_i16[(wav->channels * sample) + chan];
-	case 24:
-		return i24_to_i32(buf_i24[(wav->channels * sample) + chan]);
-	case 32:
-		return buf_i32[(wav->channels * sample) + chan];
-	default:
-		return 0;
-	};
+	batch->ops->window(lanes, wave, batch->hann, batch->nsignals / 2,
+			   batch->plan->size);
+	stats_stage(&stats, STAGE_WINDOW, t);
+	stats_count(&stats, COUNTER_WINDOWS, 1);
+
+	batch->chans[batch->nsignals] = chan;
+	batch->windows[batch->nsignals++] = window;
+	if (batch->nsignals == 2 * FFT_LANES)
+		batch_flush(batch);
 }
 
-static void extract_channel(double *wave, uint8_t *buf, unsigned int chan,
-			    const struct audio *wav)
+/* Derive the amplitude below which a window is not worth a FFT. Hann weights
+ * sum up to size / 2, so no bin can exceed peak * size / 2 and the threshold
+ * used in extract_frequencies() cannot exceed peak * size / 4: below
+ * 4 * POWER_NOISE_LEVEL / size the window would be discarded anyway. The user
+ * may raise this level with a value in dB below full scale.
+ */
+static double gate_level(const struct windows *win,
+			 const struct analyzer_opts *opts)
 {
-	unsigned int s;
-	double factor;
+	double level = 4 * POWER_NOISE_LEVEL / win->size;
+	double user_level = 0;
 
-	switch (wav->bits_per_sample) {
-	case 16:
-		factor = INT16_MAX;
-		break;
-	case 24:
-		factor = 0x7FFFFF;
-		break;
-	case 32:
-		factor = INT32_MAX;
-		break;
-	default:
-		factor = 0;
-	};
+	if (opts->gate_db)
+		user_level = pow(10, -(double)opts->gate_db / 20);
+
+	return user_level > level ? user_level : level;
+}
+
+static size_t riff_input_read(void *priv, void *buf, size_t len)
+{
+	return input_read(priv, buf, len);
+}
+
+static size_t riff_input_skip(void *priv, size_t len)
+{
+	return input_skip(priv, len);
+}
 
-	for (s = 0; s < wav->samples_per_chan; s++)
-		wave[s] = get_sample(buf, chan, s, wav) / factor;
+/* Data sizes written by tools which stream their output without knowing it */
+static bool data_size_is_placeholder(uint32_t chunk_size)
+{
+	return !chunk_size || chunk_size == 0x7FFFFFFF || chunk_size == 0xFFFFFFFF;
 }
 
-static int extract_audio_parameters(struct wav_format *wav_format, struct audio *wav)
+/* A placeholder data size stands for the rest of the input: its 'avail'
+ * bytes if known, otherwise the data is read until the end of the input and
+ * the number of samples per channel is left to 0.
+ */
+static int extract_audio_parameters(struct wav_format *wav_format,
+				    struct audio *wav, size_t avail,
+				    size_t *data_sz)
 {
-	int data_sz;
+	unsigned int frame_sz;
+	bool placeholder;
 
 	wav->channels = wav_format->channels;
 	wav->sample_rate = wav_format->samples_per_sec;
-	data_sz = wav_format->data_container.chunk_size;
-	if (!wav->channels || !wav->sample_rate || !data_sz || data_sz % wav->channels) {
-		fprintf(stderr, "Corrupted header (%u channels, %u Hz, %d B)\n",
-			wav->channels, wav->sample_rate, data_sz);
+	*data_sz = wav_format->data_container.chunk_size;
+	placeholder = data_size_is_placeholder(*data_sz);
+	if (!wav->channels || !wav->sample_rate ||
+	    (!placeholder && *data_sz % wav->channels)) {
+		fprintf(diag(), "Corrupted header (%u channels, %u Hz, %zu B)\n",
+			wav->channels, wav->sample_rate, *data_sz);
+		return -1;
+	}
+
+	if (wav_format->format_tag != WAVE_FORMAT_PCM) {
+		fprintf(diag(), "Unsupported: format 0x%04x\n",
+			wav_format->format_tag);
 		return -1;
 	}
 
@@ -223,227 +659,2311 @@ static int extract_audio_parameters(struct wav_format *wav_format, struct audio
 	case 32:
 		break;
 	default:
-		fprintf(stderr, "Unsupported: %u bits per sample\n",
+		fprintf(diag(), "Unsupported: %u bits per sample\n",
 			wav->bits_per_sample);
 		return -1;
 	}
 
-	wav->samples_per_chan = data_sz / wav->channels / (wav->bits_per_sample / 8);
+	frame_sz = wav->channels * wav->bits_per_sample / 8;
+	if (placeholder && !avail) {
+		*data_sz = INPUT_UNTIL_EOF;
+		wav->samples_per_chan = 0;
+		wav->duration_s = 0;
+		return 0;
+	} else if (placeholder) {
+		*data_sz = avail - avail % frame_sz;
+	}
+
+	wav->samples_per_chan = *data_sz / frame_sz;
 	wav->duration_s = wav->samples_per_chan / wav->sample_rate;
 	if (wav->duration_s < MIN_DURATION) {
-		fprintf(stderr, "Audio file too short (%u seconds)\n", wav->duration_s);
+		fprintf(diag(), "Audio file too short (%u seconds)\n", wav->duration_s);
 		return -1;
 	}
 
-	return data_sz;
-}
-
-static void print_help(FILE *fd, char *tool_name)
-{
-	fprintf(fd, "\n"
-		"Analyzes a WAV audio file on the standard input and exposes its major frequencies.\n"
-		"The tool extracts the audio parameters from the *.wav header.\n"
-		"Up to %u frequencies can be discovered per channel.\n"
-		"It is possible to check for frequencies generated with the same heuristics.\n\n"
-		"%s [-f <nfreqs>] < record.wav\n"
-		"	-f: Number of expected frequencies per channel\n\n",
-		MAX_FREQS_PER_CHAN, tool_name);
+	return 0;
 }
 
-static int parse_args(int argc, char *argv[], struct audio *wav)
+/* Narrow the data down to the time range selected by the user, 'skip' bytes
+ * away from the start of the data.
+ */
+static int select_range(struct audio *wav, const struct analyzer_opts *opts,
+			size_t *data_sz, size_t *skip)
 {
-	char *tool_name = argv[0];
-	int option, val;
+	unsigned int frame_sz = wav->channels * wav->bits_per_sample / 8;
+	size_t start = (size_t)opts->start_s * wav->sample_rate;
+	size_t len = (size_t)opts->length_s * wav->sample_rate;
 
-	while ((option = getopt(argc, argv, ":c:r:b:d:f:h")) != -1) {
-		switch(option){
-		case 'f':
-			val = strtol(optarg, NULL, 0);
-			wav->freqs_per_chan = val;
-			break;
-		case ':':
-			fprintf(stderr, "Missing value with option %c\n", option);
-			print_help(stderr, tool_name);
-			return -1;
-		case '?':
-			fprintf(stderr, "Unknown option: %c\n", optopt);
-			print_help(stderr, tool_name);
+	*skip = start * frame_sz;
+	if (wav->samples_per_chan) {
+		if (start >= wav->samples_per_chan) {
+			fprintf(diag(), "Start beyond the end of the audio (%u seconds)\n",
+				wav->duration_s);
 			return -1;
 		}
 
-		if (val <= 0) {
-			fprintf(stderr, "Wrong user input: negative or null value\n");
-			print_help(stderr, tool_name);
-			return -1;
-		}
+		if (!len || len > wav->samples_per_chan - start)
+			len = wav->samples_per_chan - start;
+	} else if (!len) {
+		/* Streamed until the end of the input */
+		return 0;
 	}
 
-	if (optind < argc) {
-		fprintf(stderr, "Unknown extra arguments: %s\n", argv[optind]);
-		print_help(stderr, tool_name);
+	wav->samples_per_chan = len;
+	wav->duration_s = len / wav->sample_rate;
+	*data_sz = len * frame_sz;
+	if (wav->duration_s < MIN_DURATION) {
+		fprintf(diag(), "Analyzed range too short (%u seconds)\n",
+			wav->duration_s);
 		return -1;
 	}
 
 	return 0;
 }
 
-int main(int argc, char *argv[])
+/* Streaming analysis of all the channels, fed with consecutive chunks of
+ * interleaved samples: blocks of 'slide' frames, possibly preceded by the
+ * first 'offset' frames (block -1). Each channel keeps its last two blocks,
+ * window k being analyzed when block k + 2 or the end of the data tells
+ * whether it ends at least 0.5s before the end. A channel identical to a
+ * previous one since the beginning is not analyzed, if it diverges it
+ * inherits the history and the results of that channel and goes on on its
+ * own. Channels are told apart by a hash of their samples so far, matching
+ * blocks are then compared to confirm.
+ */
+struct stream {
+	struct window_batch *batch;
+	const struct windows *win;
+	const struct audio *wav;
+	double gate;
+	int32_t **raw;
+	uint8_t **history;
+	double **peaks;
+	uint64_t **hashes;
+	unsigned int hashed;
+	int *duplicates;
+	unsigned int nchunks;
+	int block;
+	unsigned int nblocks;
+	/* Windows per channel so far, and how many of them were gated */
+	unsigned int nwindows;
+	unsigned int *ngated;
+};
+
+static int stream_init(struct stream *st, struct window_batch *batch,
+		       const struct windows *win, double gate, int block,
+		       const struct audio *wav)
 {
-	struct riff_container riff;
-	struct wav_format *wav_format = &riff.wav_container.fmt_container.wav_format;
-	const struct audio wav = {
-		.freqs_per_chan = 0,
-	};
-	unsigned int **cfreqs, **efreqs, *ncfreqs;
-	unsigned int offset, slide, windows_sz, i, c;
-	size_t sz, data_sz;
-	uint8_t *buf;
-	double *wave, *thresholds;
-	int ret = -1;
+	unsigned int c;
 
-	/* Parse args */
-	if (parse_args(argc, argv, (struct audio *)&wav))
-		return -1;
+	st->batch = batch;
+	st->win = win;
+	st->wav = wav;
+	st->gate = gate;
+	st->nchunks = 0;
+	st->hashed = 0;
+	st->block = block;
+	st->nblocks = 0;
+	st->nwindows = 0;
 
-	/* Read the *.wav file from the standard input */
-	freopen(NULL, "rb", stdin);
-	sz = fread(&riff, 1, sizeof(riff), stdin);
-	if (sz != sizeof(riff)) {
-		fprintf(stderr, "Malformed WAV file\n");
+	st->raw = (int32_t **)alloc_matrix(wav->channels, win->slide,
+					   sizeof(int32_t));
+	if (!st->raw)
 		return -1;
-	}
 
-	/* Extract parameters from the *.wav header and check their validity */
-	data_sz = extract_audio_parameters(wav_format, (struct audio *)&wav);
-	if (data_sz <= 0)
-		return 1;
+	st->history = (uint8_t **)alloc_matrix(wav->channels, win->size,
+					       batch->ops->sample_size);
+	if (!st->history)
+		goto free_raw;
 
-	fprintf(stderr, "Analyzing audio file with following parameters:\n");
-	log_parameters(stderr, &wav);
-	fprintf(stderr, "\n");
+	st->peaks = (double **)alloc_matrix(wav->channels, 2, sizeof(double));
+	if (!st->peaks)
+		goto free_history;
 
-	/* Read the *.wav sound data */
-	buf = malloc(data_sz);
-	if (!buf)
-		return -1;
+	st->hashes = (uint64_t **)alloc_matrix(wav->channels, HASH_LANES,
+					       sizeof(uint64_t));
+	if (!st->hashes)
+		goto free_peaks;
 
-	sz = fread(buf, 1, data_sz, stdin);
-	if (sz != data_sz) {
-		fprintf(stderr, "Partial audio content, aborting\n");
-		goto free_buf;
-	}
+	for (c = 0; c < wav->channels; c++)
+		hash_init(st->hashes[c]);
 
-	/* Allocate the array to store the frequencies extracted from the file */
-	ncfreqs = calloc(wav.channels, sizeof(unsigned int));
-	if (!ncfreqs)
-		goto free_buf;
+	st->duplicates = calloc(wav->channels, sizeof(int));
+	if (!st->duplicates)
+		goto free_hashes;
 
-	cfreqs = (unsigned int **)alloc_matrix(wav.channels, MAX_FREQS_PER_CHAN,
-					       sizeof(unsigned int));
-	if (!cfreqs)
-		goto free_ncfreqs;
+	st->ngated = calloc(wav->channels, sizeof(unsigned int));
+	if (!st->ngated)
+		goto free_duplicates;
 
-	thresholds = calloc(wav.channels, sizeof(double));
-	if (!thresholds)
-		goto free_cfreqs;
+	return 0;
 
-	/* Process each channel, one at a time, with a sliding FFT:
-	 * - Make the window at least 1s wide.
-	 * - Start after 0.5s, stop 0.5s from the end to avoid possible glitches.
-	 * - Slide the window by 0.5s to ensure a sufficient overlap.
-	 * - The slide/window size are rounded up to the next higher power of 2
-	 *   in order to match the library requirements.
-	 */
-	wave = malloc(wav.samples_per_chan * sizeof(double));
-	if (!wave)
-		goto free_thresholds;
+free_duplicates:
+	free(st->duplicates);
+free_hashes:
+	free_array((void **)st->hashes, wav->channels);
+	free(st->hashes);
+free_peaks:
+	free_array((void **)st->peaks, wav->channels);
+	free(st->peaks);
+free_history:
+	free_array((void **)st->history, wav->channels);
+	free(st->history);
+free_raw:
+	free_array((void **)st->raw, wav->channels);
+	free(st->raw);
+
+	return -1;
+}
+
+static void stream_cleanup(struct stream *st)
+{
+	unsigned int channels = st->wav->channels;
+
+	free(st->ngated);
+	free(st->duplicates);
+	free_array((void **)st->hashes, channels);
+	free(st->hashes);
+	free_array((void **)st->peaks, channels);
+	free(st->peaks);
+	free_array((void **)st->history, channels);
+	free(st->history);
+	free_array((void **)st->raw, channels);
+	free(st->raw);
+}
+
+/* Compare the hashes of two channels, and their last block on a match */
+static bool stream_same(struct stream *st, unsigned int c1, unsigned int c2,
+			unsigned int n)
+{
+	return hash_final(st->hashes[c1]) == hash_final(st->hashes[c2]) &&
+	       !memcmp(st->raw[c1], st->raw[c2], n * sizeof(int32_t));
+}
+
+/* Look for a previous analyzed channel with the same first samples */
+static int stream_find_duplicate(struct stream *st, unsigned int chan,
+				 unsigned int n)
+{
+	unsigned int c;
+
+	for (c = 0; c < chan; c++)
+		if (st->duplicates[c] < 0 && stream_same(st, c, chan, n))
+			return c;
+
+	return -1;
+}
+
+/* A channel diverged from its original, resume from the state of the latter */
+static void stream_inherit(struct stream *st, unsigned int chan,
+			   unsigned int orig)
+{
+	struct window_batch *batch = st->batch;
 
-	offset = wav.sample_rate / 2;
-	slide = next_pow_2(wav.sample_rate / 2);
-	windows_sz = 2 * slide;
-	for (c = 0; c < wav.channels; c++) {
-		/* Extract samples from a single channel and convert them into floats */
-		extract_channel(wave, buf, c, &wav);
+	memcpy(st->history[chan], st->history[orig],
+	       st->win->size * batch->ops->sample_size);
+	memcpy(st->peaks[chan], st->peaks[orig], 2 * sizeof(double));
+	memcpy(batch->cfreqs[chan], batch->cfreqs[orig],
+	       MAX_FREQS_PER_CHAN * sizeof(unsigned int));
+	batch->ncfreqs[chan] = batch->ncfreqs[orig];
+	batch->thresholds[chan] = batch->thresholds[orig];
+	st->ngated[chan] = st->ngated[orig];
+}
+
+/* Analyze the window in history if it ends 0.5s before the end of the data,
+ * knowing 'tail' frames follow it. When the length of the data is unknown, a
+ * full block is assumed to be followed by more data.
+ */
+static void stream_window(struct stream *st, unsigned int tail)
+{
+	const struct windows *win = st->win;
+	const struct audio *wav = st->wav;
+	struct window_batch *batch = st->batch;
+	unsigned int window = st->block - 2, start, c;
+	double *peaks;
 
-		/* Perform a sliding window discrete FFT */
-		for (i = offset; i + windows_sz < wav.samples_per_chan - offset; i += slide)
-			extract_frequencies(cfreqs[c], &ncfreqs[c], &wave[i],
-					    windows_sz, &thresholds[c], &wav);
+	start = win->offset + window * win->slide;
+	if (wav->samples_per_chan) {
+		if (start + win->size >= wav->samples_per_chan - win->offset)
+			return;
+	} else if (tail <= win->offset && tail != win->slide) {
+		return;
 	}
 
-	/* The user did not require frequency comparisons, just print the analysis */
-	if (!wav.freqs_per_chan) {
-		for (c = 0; c < wav.channels; c++) {
-			printf("Frequencies found on channel %d (max threshold: %.1f):\n",
-			       c, thresholds[c]);
-			if (!ncfreqs[c])
-				printf("None.\n");
-			for (i = 0; i < ncfreqs[c]; i++)
-				printf("* %u Hz\n", cfreqs[c][i]);
+	st->nwindows++;
+	for (c = 0; c < wav->channels; c++) {
+		if (st->duplicates[c] >= 0)
+			continue;
+
+		peaks = st->peaks[c];
+		if (peaks[0] < st->gate && peaks[1] < st->gate) {
+			st->ngated[c]++;
+			stats_count(&stats, COUNTER_GATED, 1);
+			if (batch->report)
+				batch->report(batch->priv, c, window, NULL, 0);
+			continue;
 		}
 
-		ret = 0;
-		goto free_wave;
+		batch_push(batch, st->history[c], c, window);
 	}
 
-	/* List expected frequencies per channel */
-	efreqs = (unsigned int **)alloc_matrix(wav.channels, wav.freqs_per_chan,
-					       sizeof(unsigned int));
-	if (!efreqs)
-		goto free_wave;
+	/* Reported windows are not kept waiting for a full batch */
+	if (batch->report)
+		batch_flush(batch);
+}
 
-	if (fill_desired_freqs(efreqs, &wav))
-		goto free_efreqs;
+static void stream_feed(struct stream *st, const uint8_t *chunk,
+			unsigned int n)
+{
+	const struct audio *wav = st->wav;
+	struct window_batch *batch = st->batch;
+	size_t half = st->win->slide * batch->ops->sample_size;
+	bool flushed = false;
+	uint8_t *history;
+	double *peaks;
+	unsigned int c;
+	uint64_t t;
+	int orig;
 
-	/* Compare computed and expected frequencies */
-	for (c = 0; c < wav.channels; c++) {
-		unsigned int found = 0, i;
-		bool is_listed;
+	stats_count(&stats, COUNTER_BYTES,
+		    (uint64_t)n * wav->channels * wav->bits_per_sample / 8);
 
-		printf("Frequencies expected on channel %d (%smax threshold: %.1f):\n",
-		       c, !ncfreqs[c] ? "empty, " : "", thresholds[c]);
-		for (i = 0; i < wav.freqs_per_chan; i++) {
-			is_listed = freq_is_listed(cfreqs[c], ncfreqs[c], efreqs[c][i]);
-			printf("* %u/ %u Hz: ", i, efreqs[c][i]);
-			if (!is_listed) {
-				printf("KO\n");
-			} else {
-				int diff = cfreqs[c][i] - efreqs[c][i];
-				printf("ok");
-				if (diff)
-					printf(" (%d Hz)", diff);
-				printf("\n");
-				found++;
-			}
-		}
+	t = stats_now(&stats);
+	for (c = 0; c < wav->channels; c++)
+		kernels->unpack(st->raw[c], chunk, c, wav->channels,
+				wav->bits_per_sample, n);
+	stats_stage(&stats, STAGE_UNPACK, t);
 
-		if (found < ncfreqs[c]) {
-			printf("Frequencies *not* expected on channel %d:\n", c);
-			for (i = 0; i < ncfreqs[c]; i++) {
-				is_listed = freq_is_listed(efreqs[c], wav.freqs_per_chan,
-							   cfreqs[c][i]);
-				if (!is_listed)
-					printf("*    %u Hz: spurious\n", cfreqs[c][i]);
-			}
+	/* Track duplicated channels, the pending windows of the original
+	 * channel must be processed before inheriting its results.
+	 */
+	t = stats_now(&stats);
+	for (c = 0; c < wav->channels; c++)
+		hash_block(st->hashes[c], st->raw[c], st->hashed, n);
+	st->hashed += n;
+
+	for (c = 0; c < wav->channels; c++) {
+		if (!st->nchunks) {
+			st->duplicates[c] = stream_find_duplicate(st, c, n);
+			continue;
 		}
+
+		orig = st->duplicates[c];
+		if (orig < 0 || stream_same(st, c, orig, n))
+			continue;
+
+		if (!flushed)
+			batch_flush(batch);
+		flushed = true;
+
+		stream_inherit(st, c, orig);
+		st->duplicates[c] = -1;
 	}
-	printf("\n");
+	stats_stage(&stats, STAGE_DEDUP, t);
 
-	ret = 0;
-free_efreqs:
-	free_array((void **)efreqs, wav.channels);
-	free(efreqs);
-free_wave:
-	free(wave);
-free_thresholds:
-	free(thresholds);
-free_cfreqs:
-	free_array((void **)cfreqs, wav.channels);
-	free(cfreqs);
-free_ncfreqs:
-	free(ncfreqs);
-free_buf:
-	free(buf);
+	/* The chunk before the first window is only compared */
+	st->nchunks++;
+	if (st->block < 0) {
+		st->block++;
+		return;
+	}
+
+	if (st->nblocks == 2)
+		stream_window(st, n);
+	else
+		st->nblocks++;
+
+	st->block++;
+	t = stats_now(&stats);
+	for (c = 0; c < wav->channels; c++) {
+		if (st->duplicates[c] >= 0)
+			continue;
+
+		history = st->history[c];
+		peaks = st->peaks[c];
+		memcpy(history, history + half, half);
+		peaks[0] = peaks[1];
+		peaks[1] = batch->ops->convert(history + half, st->raw[c], n, wav);
+	}
+	stats_stage(&stats, STAGE_CONVERT, t);
+}
+
+/* Analysis of a range of the data chunk, with its own results */
+struct analysis {
+	unsigned int **cfreqs;
+	unsigned int *ncfreqs;
+	double *thresholds;
+	struct window_batch batch;
+	struct stream st;
+	/* Range of the data analyzed by a separate thread or a pool task */
+	pthread_t thread;
+	atomic_uint *left;
+	const uint8_t *data;
+	size_t len;
+	size_t first;
+	size_t chunk;
+	unsigned int frame_sz;
+};
+
+static int analysis_init(struct analysis *an, const struct windows *win,
+			 double gate, int block,
+			 const struct window_tables *tables,
+			 const struct audio *wav)
+{
+	/* Allocate the array to store the frequencies extracted from the file */
+	an->ncfreqs = calloc(wav->channels, sizeof(unsigned int));
+	if (!an->ncfreqs)
+		return -1;
+
+	an->cfreqs = (unsigned int **)alloc_matrix(wav->channels,
+						   MAX_FREQS_PER_CHAN,
+						   sizeof(unsigned int));
+	if (!an->cfreqs)
+		goto free_ncfreqs;
+
+	an->thresholds = calloc(wav->channels, sizeof(double));
+	if (!an->thresholds)
+		goto free_cfreqs;
+
+	if (batch_init(&an->batch, tables))
+		goto free_thresholds;
+
+	an->batch.cfreqs = an->cfreqs;
+	an->batch.ncfreqs = an->ncfreqs;
+	an->batch.thresholds = an->thresholds;
+	an->batch.wav = wav;
+
+	if (stream_init(&an->st, &an->batch, win, gate, block, wav))
+		goto cleanup_batch;
+
+	return 0;
+
+cleanup_batch:
+	batch_cleanup(&an->batch);
+free_thresholds:
+	free(an->thresholds);
+free_cfreqs:
+	free_array((void **)an->cfreqs, wav->channels);
+	free(an->cfreqs);
+free_ncfreqs:
+	free(an->ncfreqs);
+
+	return -1;
+}
+
+static void analysis_cleanup(struct analysis *an, const struct audio *wav)
+{
+	stream_cleanup(&an->st);
+	batch_cleanup(&an->batch);
+	free(an->thresholds);
+	free_array((void **)an->cfreqs, wav->channels);
+	free(an->cfreqs);
+	free(an->ncfreqs);
+}
+
+/* Process the remaining windows, duplicates share the analysis of the
+ * original channel.
+ */
+static void analysis_finish(struct analysis *an, const struct audio *wav)
+{
+	int *duplicates = an->st.duplicates;
+	unsigned int c;
+
+	if (an->st.nblocks == 2)
+		stream_window(&an->st, 0);
+
+	batch_flush(&an->batch);
+
+	for (c = 0; c < wav->channels; c++) {
+		if (duplicates[c] < 0)
+			continue;
+
+		memcpy(an->cfreqs[c], an->cfreqs[duplicates[c]],
+		       MAX_FREQS_PER_CHAN * sizeof(unsigned int));
+		an->ncfreqs[c] = an->ncfreqs[duplicates[c]];
+		an->thresholds[c] = an->thresholds[duplicates[c]];
+		an->st.ngated[c] = an->st.ngated[duplicates[c]];
+	}
+}
+
+/* Merge the results of the next range. A channel is only reported as a
+ * duplicate if it is one over all the ranges.
+ */
+static void analysis_merge(struct analysis *an, const struct analysis *next,
+			   const struct audio *wav)
+{
+	unsigned int c, i;
+
+	for (c = 0; c < wav->channels; c++) {
+		for (i = 0; i < next->ncfreqs[c]; i++)
+			add_freq_to_list(an->cfreqs[c], &an->ncfreqs[c],
+					 next->cfreqs[c][i]);
+
+		if (next->thresholds[c] > an->thresholds[c])
+			an->thresholds[c] = next->thresholds[c];
+
+		if (next->st.duplicates[c] != an->st.duplicates[c])
+			an->st.duplicates[c] = -1;
+
+		an->st.ngated[c] += next->st.ngated[c];
+	}
+
+	an->st.nwindows += next->st.nwindows;
+}
+
+static void *analysis_run(void *data)
+{
+	struct analysis *an = data;
+	size_t pos, len;
+
+	for (pos = 0, len = an->first; pos < an->len; len = an->chunk) {
+		if (len > an->len - pos)
+			len = an->len - pos;
+
+		stream_feed(&an->st, an->data + pos, len / an->frame_sz);
+		pos += len;
+	}
+
+	analysis_finish(an, an->st.wav);
+
+	return NULL;
+}
+
+static void analysis_task(void *data)
+{
+	struct analysis *an = data;
+
+	analysis_run(an);
+	atomic_fetch_sub(an->left, 1);
+}
+
+/* Split the windows in ranges analyzed in parallel. Each range starts with
+ * the first block of its first window, which is also the last block of the
+ * previous range, the first range starts at the beginning of the data and
+ * the last one goes until its end so duplicates are compared over the whole
+ * data chunk. The results are merged into the first range. The ranges are
+ * tasks of the pool if any, threads otherwise.
+ */
+static int analyze_ranges(struct analysis *an, unsigned int nranges,
+			  const uint8_t *data, size_t data_sz,
+			  const struct windows *win, double gate,
+			  const struct window_tables *tables,
+			  const struct audio *wav, struct pool *pool)
+{
+	unsigned int frame_sz = wav->channels * wav->bits_per_sample / 8;
+	unsigned int nwindows, first, next, r, i;
+	struct analysis *ranges, *range;
+	atomic_uint left = 0;
+	size_t start, end;
+
+	/* Windows which end 0.5s before the end of the data */
+	for (nwindows = 0;
+	     win->offset + nwindows * win->slide + win->size <
+	     wav->samples_per_chan - win->offset;
+	     nwindows++)
+		;
+
+	if (nranges > nwindows)
+		nranges = nwindows ? nwindows : 1;
+
+	/* The first range is the main analysis */
+	ranges = calloc(nranges, sizeof(*ranges));
+	if (!ranges)
+		return -1;
+
+	for (r = 0; r < nranges; r++) {
+		range = r ? &ranges[r] : an;
+		first = nwindows * r / nranges;
+		next = nwindows * (r + 1) / nranges;
+		start = r ? (size_t)(win->offset + first * win->slide) * frame_sz : 0;
+		end = (size_t)(win->offset + (next + 1) * win->slide) * frame_sz;
+		if (r == nranges - 1 || end > data_sz)
+			end = data_sz;
+
+		if (r && analysis_init(range, win, gate, first, tables, wav))
+			break;
+
+		range->data = data + start;
+		range->len = end - start;
+		range->first = (r ? win->slide : win->offset) * frame_sz;
+		range->chunk = win->slide * frame_sz;
+		range->frame_sz = frame_sz;
+		range->left = &left;
+		if (!r)
+			continue;
+
+		if (pool) {
+			atomic_fetch_add(&left, 1);
+			if (!pool_submit(pool, analysis_task, range))
+				continue;
+			atomic_fetch_sub(&left, 1);
+		} else if (!pthread_create(&range->thread, NULL, analysis_run,
+					   range)) {
+			continue;
+		}
+
+		analysis_cleanup(range, wav);
+		break;
+	}
+
+	/* Meanwhile, analyze the first range from the current thread */
+	if (r == nranges)
+		analysis_run(an);
+
+	if (pool)
+		pool_help(pool, &left);
+
+	for (i = 1; i < r; i++) {
+		if (!pool)
+			pthread_join(ranges[i].thread, NULL);
+		analysis_merge(an, &ranges[i], wav);
+		analysis_cleanup(&ranges[i], wav);
+	}
+
+	free(ranges);
+
+	return r == nranges ? 0 : -1;
+}
+
+/* Memory used by the analysis of a range: its batch and the blocks kept by its
+ * stream.
+ */
+static size_t range_footprint(const struct windows *win,
+			      const struct precision_ops *ops,
+			      const struct audio *wav)
+{
+	return 2 * win->size * FFT_LANES * ops->sample_size +
+	       (win->size / 2 + 1) * 2 * FFT_LANES * ops->power_size +
+	       wav->channels * (win->slide * sizeof(int32_t) +
+				win->size * ops->sample_size);
+}
+
+/* Fit an analysis in the memory limit. The pages of a mapped input stay
+ * resident, so it counts as a whole: fewer ranges are analyzed in parallel,
+ * or the input is streamed through the ring of the reader if not even one
+ * fits. Fails with the least memory needed otherwise.
+ */
+static int fit_memory(struct input *in, const struct analyzer_opts *opts,
+		      size_t data_sz, const struct windows *win,
+		      const struct audio *wav, unsigned int *nranges)
+{
+	const struct precision_ops *ops = precision_ops(opts->precision);
+	unsigned int frame_sz = wav->channels * wav->bits_per_sample / 8;
+	size_t limit = (size_t)opts->mem_limit << 20;
+	size_t range, tables, ring, n;
+
+	*nranges = opts->jobs;
+	if (!opts->mem_limit)
+		return 0;
+
+	/* Hann window, FFT twiddles and bit reversal permutation */
+	range = range_footprint(win, ops, wav);
+	tables = win->size * (2 * ops->sample_size + sizeof(unsigned int));
+
+	if (input_mapped(in, data_sz) && limit > data_sz + tables) {
+		n = (limit - data_sz - tables) / range;
+		if (n) {
+			if (n < *nranges)
+				*nranges = n;
+			return 0;
+		}
+	}
+
+	/* The slide is at least the offset of the first window */
+	ring = INPUT_RING_SLOTS * (size_t)win->slide * frame_sz;
+	if (tables + ring + range > limit) {
+		fprintf(diag(), "Memory limit of %u MiB too low: needs at least %zu KiB\n",
+			opts->mem_limit, (tables + ring + range + 1023) >> 10);
+		return -1;
+	}
+
+	*nranges = 1;
+
+	return input_unmap(in);
+}
+
+/* Verdicts printed for each window of a followed file */
+struct follow {
+	const struct audio *wav;
+	const struct windows *win;
+	unsigned int **efreqs;
+	unsigned int start_s;
+};
+
+static void follow_report(void *priv, unsigned int chan, unsigned int window,
+			  const unsigned int *freqs, unsigned int nfreqs)
+{
+	const struct follow *fl = priv;
+	const struct audio *wav = fl->wav;
+	unsigned int *efreqs, i;
+	bool ok = true;
+
+	printf("%.1fs: channel %u: ", fl->start_s +
+	       (double)(fl->win->offset + window * fl->win->slide) /
+	       wav->sample_rate, chan);
+	if (!freqs) {
+		printf("silent\n");
+	} else if (!fl->efreqs) {
+		for (i = 0; i < nfreqs; i++)
+			printf("%u ", freqs[i]);
+		printf(nfreqs ? "Hz\n" : "none\n");
+	} else {
+		efreqs = fl->efreqs[chan];
+		for (i = 0; i < wav->freqs_per_chan; i++) {
+			if (freq_is_listed(freqs, nfreqs, efreqs[i]))
+				continue;
+
+			printf("%smissing %u Hz", ok ? "KO (" : ", ", efreqs[i]);
+			ok = false;
+		}
+
+		for (i = 0; i < nfreqs; i++) {
+			if (freq_is_listed(efreqs, wav->freqs_per_chan, freqs[i]))
+				continue;
+
+			printf("%sspurious %u Hz", ok ? "KO (" : ", ", freqs[i]);
+			ok = false;
+		}
+
+		printf(ok ? "ok\n" : ")\n");
+	}
+
+	fflush(stdout);
+}
+
+static struct input *followed;
+
+static void follow_interrupt(int sig)
+{
+	(void)sig;
+	input_interrupt(followed);
+}
+
+static void print_help(FILE *fd, char *tool_name)
+{
+	fprintf(fd, "\n"
+		"Analyzes a WAV audio file, given as argument or on the standard input, and\n"
+		"exposes its major frequencies.\n"
+		"The tool extracts the audio parameters from the *.wav header, or takes them\n"
+		"from the command line for raw interleaved PCM input.\n"
+		"Up to %u frequencies can be discovered per channel.\n"
+		"It is possible to check for frequencies generated with the same heuristics.\n"
+		"Several files are analyzed in parallel, their reports are followed by the\n"
+		"list of the files whose analysis failed.\n\n"
+		"%s [-c <nchans> -r <rate> -b <bps>] [-f <nfreqs>] [-g <dB>] [-j <threads>] [--start=<s>] [--length=<s>] [--follow] [--daemon=<socket>] [--connect=<socket>] [--fd=<n>] [--watch=<dir>] [--manifest=<file> [--shard=<i>/<n>]] [--merge] [--stats[=<fmt>]] [--trace=<file>] [--perf-counters] [--mem-limit=<MiB>] [--precision=<p>] [record.wav...] [< record.wav]\n"
+		"	-c: Number of channels of a raw input\n"
+		"	-r: Sampling rate in Hz of a raw input\n"
+		"	-b: Bits per sample of a raw input (supp: 16, 24, 32)\n"
+		"	-f: Number of expected frequencies per channel\n"
+		"	-g: Skip windows whose peak is below -<dB> dBFS (default: only skip\n"
+		"	    windows that would be discarded as noise anyway)\n"
+		"	-j: Number of threads analyzing ranges of an input file, or the\n"
+		"	    files given (default: 1)\n"
+		"	--start: Start of the analysis in seconds, skipped without reading on\n"
+		"	         files (default: 0)\n"
+		"	--length: Duration of the analysis in seconds (default: until the end)\n"
+		"	--follow: Analyze a file while it is being written, printing a verdict\n"
+		"	          per window and channel as soon as possible, until the writer\n"
+		"	          closes it, its announced size is reached or SIGINT\n"
+		"	--daemon: Serve analyses on a Unix socket, keeping the FFT tables\n"
+		"	          from one analysis to the next. Up to %u clients are served\n"
+		"	          at once, the ranges of their analyses run on -j workers,\n"
+		"	          requests with statistics are served alone\n"
+		"	--connect: Run the analysis in the daemon listening on a Unix socket,\n"
+		"	           which reads the file itself or the standard input from here\n"
+		"	--fd: Analyze an inherited descriptor instead of a path, mapped when\n"
+		"	      it is a regular file or a memfd, from its start. Through the\n"
+		"	      daemon, the descriptor itself is passed\n"
+		"	--watch: Analyze the *.wav files closed or moved in a directory, and\n"
+		"	         the ones without result yet, with -j workers, writing the\n"
+		"	         report of each file in <file>.result, until SIGINT\n"
+		"	--manifest: Analyze the files listed in a file, one per line, relative\n"
+		"	            to the manifest\n"
+		"	--shard: Only analyze shard <i> of <n> (from 0) of the manifest, split\n"
+		"	         by file sizes, printing a partial result\n"
+		"	--merge: Combine the partial results given instead of record files\n"
+		"	--stats: Print the time spent in each stage and the throughput on the\n"
+		"	         standard error, as text or json (default: text)\n"
+		"	--trace: Record the stages run by each thread and write them to a\n"
+		"	         file in the Chrome trace event format (chrome://tracing,\n"
+		"	         Perfetto)\n"
+		"	--perf-counters: Count the cycles, instructions, cache and branch\n"
+		"	                 misses of each stage along with its time, when the\n"
+		"	                 host provides hardware counters\n"
+		"	--mem-limit: Memory of each analysis in MiB, a mapped file counting as\n"
+		"	             a whole: analyze fewer ranges in parallel or stream the\n"
+		"	             file to fit, or fail with the memory needed\n"
+		"	--precision: Arithmetic used by the analysis (default: %s)\n"
+		"	    double: Reference\n"
+		"	    float: Half the memory and twice the SIMD width, detected\n"
+		"	           frequencies match the double path, thresholds differ by\n"
+		"	           less than 0.0001%%\n"
+		"	    fixed: Q31 integer arithmetic for targets without FPU, detected\n"
+		"	           frequencies match the double path, thresholds differ by\n"
+		"	           less than 0.01%%\n"
+		"Set %s to force the SIMD kernels (scalar, sse2, avx2, avx512)\n\n",
+		MAX_FREQS_PER_CHAN, tool_name, DAEMON_CLIENTS, DEFAULT_PRECISION,
+		KERNELS_ENV);
+}
+
+static int parse_precision(const char *name, enum precision *precision)
+{
+	if (!strcmp(name, "double"))
+		*precision = PRECISION_DOUBLE;
+	else if (!strcmp(name, "float"))
+		*precision = PRECISION_FLOAT;
+	else if (!strcmp(name, "fixed"))
+		*precision = PRECISION_FIXED;
+	else
+		return -1;
+
+	return 0;
+}
+
+enum {
+	OPT_PRECISION = 256,
+	OPT_START,
+	OPT_LENGTH,
+	OPT_FOLLOW,
+	OPT_DAEMON,
+	OPT_CONNECT,
+	OPT_FD,
+	OPT_WATCH,
+	OPT_MANIFEST,
+	OPT_SHARD,
+	OPT_MERGE,
+	OPT_STATS,
+	OPT_TRACE,
+	OPT_MEM_LIMIT,
+	OPT_PERF_COUNTERS,
+};
+
+static const struct option long_options[] = {
+	{ "precision", required_argument, NULL, OPT_PRECISION },
+	{ "start", required_argument, NULL, OPT_START },
+	{ "length", required_argument, NULL, OPT_LENGTH },
+	{ "follow", no_argument, NULL, OPT_FOLLOW },
+	{ "daemon", required_argument, NULL, OPT_DAEMON },
+	{ "connect", required_argument, NULL, OPT_CONNECT },
+	{ "fd", required_argument, NULL, OPT_FD },
+	{ "watch", required_argument, NULL, OPT_WATCH },
+	{ "manifest", required_argument, NULL, OPT_MANIFEST },
+	{ "shard", required_argument, NULL, OPT_SHARD },
+	{ "merge", no_argument, NULL, OPT_MERGE },
+	{ "stats", optional_argument, NULL, OPT_STATS },
+	{ "trace", required_argument, NULL, OPT_TRACE },
+	{ "mem-limit", required_argument, NULL, OPT_MEM_LIMIT },
+	{ "perf-counters", no_argument, NULL, OPT_PERF_COUNTERS },
+	{ NULL, 0, NULL, 0 },
+};
+
+static int parse_args(int argc, char *argv[], struct audio *wav,
+		      struct analyzer_opts *opts)
+{
+	char *tool_name = argv[0];
+	int option, val;
+
+	while ((option = getopt_long(argc, argv, ":c:r:b:d:f:g:j:h",
+				     long_options, NULL)) != -1) {
+		switch(option){
+		case 'c':
+			val = strtol(optarg, NULL, 0);
+			opts->raw.channels = val;
+			break;
+		case 'r':
+			val = strtol(optarg, NULL, 0);
+			opts->raw.samples_per_sec = val;
+			break;
+		case 'b':
+			val = strtol(optarg, NULL, 0);
+			opts->raw.pcm_format.bits_per_sample = val;
+			break;
+		case 'f':
+			val = strtol(optarg, NULL, 0);
+			wav->freqs_per_chan = val;
+			break;
+		case 'g':
+			val = strtol(optarg, NULL, 0);
+			opts->gate_db = val;
+			break;
+		case 'j':
+			val = strtol(optarg, NULL, 0);
+			opts->jobs = val;
+			break;
+		case OPT_START:
+			val = strtol(optarg, NULL, 0);
+			opts->start_s = val;
+			/* Starting from the beginning is valid */
+			if (!val)
+				val = 1;
+			break;
+		case OPT_LENGTH:
+			val = strtol(optarg, NULL, 0);
+			opts->length_s = val;
+			break;
+		case OPT_FOLLOW:
+			val = 1;
+			opts->follow = true;
+			break;
+		case OPT_DAEMON:
+			val = 1;
+			opts->daemon = optarg;
+			break;
+		case OPT_CONNECT:
+			val = 1;
+			opts->connect = optarg;
+			break;
+		case OPT_FD:
+			val = strtol(optarg, NULL, 0);
+			opts->fd = val;
+			/* The standard input is a valid descriptor */
+			if (!val)
+				val = 1;
+			break;
+		case OPT_WATCH:
+			val = 1;
+			opts->watch = optarg;
+			break;
+		case OPT_MANIFEST:
+			val = 1;
+			opts->manifest = optarg;
+			break;
+		case OPT_SHARD:
+			val = 1;
+			if (sscanf(optarg, "%u/%u", &opts->shard,
+				   &opts->nshards) != 2 ||
+			    opts->shard >= opts->nshards) {
+				fprintf(diag(), "Wrong shard: %s\n", optarg);
+				print_help(diag(), tool_name);
+				return -1;
+			}
+			break;
+		case OPT_MERGE:
+			val = 1;
+			opts->merge = true;
+			break;
+		case OPT_STATS:
+			val = 1;
+			if (stats_parse(optarg, &opts->stats)) {
+				fprintf(diag(), "Unknown statistics format: %s\n",
+					optarg);
+				print_help(diag(), tool_name);
+				return -1;
+			}
+			break;
+		case OPT_TRACE:
+			val = 1;
+			opts->trace = optarg;
+			break;
+		case OPT_MEM_LIMIT:
+			val = strtol(optarg, NULL, 0);
+			opts->mem_limit = val;
+			break;
+		case OPT_PERF_COUNTERS:
+			val = 1;
+			opts->perf_counters = true;
+			break;
+		case OPT_PRECISION:
+			val = 1;
+			if (parse_precision(optarg, &opts->precision)) {
+				fprintf(diag(), "Unknown precision: %s\n", optarg);
+				print_help(diag(), tool_name);
+				return -1;
+			}
+			break;
+		case 'h':
+			print_help(diag(), tool_name);
+			return -1;
+		case ':':
+			fprintf(diag(), "Missing value with option %c\n", option);
+			print_help(diag(), tool_name);
+			return -1;
+		case '?':
+			fprintf(diag(), "Unknown option: %c\n", optopt);
+			print_help(diag(), tool_name);
+			return -1;
+		}
+
+		if (val <= 0) {
+			fprintf(diag(), "Wrong user input: negative or null value\n");
+			print_help(diag(), tool_name);
+			return -1;
+		}
+	}
+
+	if ((opts->raw.channels || opts->raw.samples_per_sec ||
+	     opts->raw.pcm_format.bits_per_sample) &&
+	    (!opts->raw.channels || !opts->raw.samples_per_sec ||
+	     !opts->raw.pcm_format.bits_per_sample)) {
+		fprintf(diag(), "Raw input requires -c, -r and -b\n");
+		print_help(diag(), tool_name);
+		return -1;
+	}
+
+	if (optind < argc) {
+		opts->paths = &argv[optind];
+		opts->npaths = argc - optind;
+		opts->path = opts->paths[0];
+	}
+
+	if (opts->path && opts->fd >= 0) {
+		fprintf(diag(), "A path and a descriptor are exclusive\n");
+		print_help(diag(), tool_name);
+		return -1;
+	}
+
+	if (opts->watch && (opts->path || opts->fd >= 0 || opts->follow)) {
+		fprintf(diag(), "A watched directory and an input are exclusive\n");
+		print_help(diag(), tool_name);
+		return -1;
+	}
+
+	if (opts->manifest && (opts->npaths || opts->fd >= 0 || opts->watch)) {
+		fprintf(diag(), "A manifest and other inputs are exclusive\n");
+		print_help(diag(), tool_name);
+		return -1;
+	}
+
+	if (opts->nshards && !opts->manifest) {
+		fprintf(diag(), "Shards are taken from a manifest\n");
+		print_help(diag(), tool_name);
+		return -1;
+	}
+
+	if (opts->merge && (!opts->npaths || opts->manifest)) {
+		fprintf(diag(), "Merging requires partial results only\n");
+		print_help(diag(), tool_name);
+		return -1;
+	}
+
+	if (opts->npaths > 1 && opts->follow) {
+		fprintf(diag(), "Only one file can be followed\n");
+		print_help(diag(), tool_name);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Analyze an opened input, completing the audio parameters from its header.
+ * The report goes to 'out', diagnostics to the standard error.
+ */
+static int analyze(struct input *in, const struct analyzer_opts *opts,
+		   struct audio *wav, struct tables_cache *cache, FILE *out)
+{
+	unsigned int **cfreqs, **efreqs = NULL, *ncfreqs, frame_sz, nranges, i, c;
+	const struct window_tables *tables;
+	struct wav_format wav_format;
+	struct analysis an;
+	struct windows win;
+	struct follow fl;
+	unsigned int nwindows = 0, ngated = 0;
+	const uint8_t *data, *chunk;
+	int *duplicates, more, ret = -1;
+	double *thresholds, gate;
+	size_t data_sz, skip, sz;
+	uint64_t t;
+
+	/* A raw input is made of samples only, until its end */
+	t = stats_now(&stats);
+	if (opts->raw.channels) {
+		wav_format = opts->raw;
+		wav_format.format_tag = WAVE_FORMAT_PCM;
+	} else {
+		struct riff_io io = {
+			.read = riff_input_read,
+			.skip = riff_input_skip,
+			.priv = in,
+		};
+
+		if (riff_find_data(&io, &wav_format))
+			return -1;
+	}
+
+	/* Extract parameters from the *.wav header and check their validity */
+	if (extract_audio_parameters(&wav_format, wav, input_avail(in),
+				     &data_sz))
+		return 1;
+
+	if (select_range(wav, opts, &data_sz, &skip))
+		return 1;
+
+	if (input_skip(in, skip) != skip) {
+		fprintf(diag(), "Cannot reach the start of the analysis\n");
+		return -1;
+	}
+	stats_stage(&stats, STAGE_HEADER, t);
+
+	fprintf(diag(), "Analyzing audio file with following parameters:\n");
+	log_parameters(diag(), wav);
+	fprintf(diag(), "\n");
+
+	/* Process the channels with a sliding FFT, while reading them:
+	 * - Make the window at least 1s wide.
+	 * - Start after 0.5s, stop 0.5s from the end to avoid possible glitches.
+	 * - Slide the window by 0.5s to ensure a sufficient overlap.
+	 * - The slide/window size are rounded up to the next higher power of 2
+	 *   in order to match the FFT requirements.
+	 * - Windows are transformed in batches, two per complex FFT.
+	 * - Skip the FFT on windows whose peak amplitude is below the gate level
+	 *   (typically digital silence before/after the playback).
+	 * - Channels with the exact same content as a previous one share its
+	 *   analysis.
+	 * - Mapped files may be split in ranges of windows analyzed in parallel.
+	 */
+	win.offset = wav->sample_rate / 2;
+	win.slide = next_pow_2(wav->sample_rate / 2);
+	win.size = 2 * win.slide;
+	gate = gate_level(&win, opts);
+
+	/* List expected frequencies per channel */
+	if (wav->freqs_per_chan) {
+		efreqs = (unsigned int **)alloc_matrix(wav->channels,
+						       wav->freqs_per_chan,
+						       sizeof(unsigned int));
+		if (!efreqs)
+			return -1;
+
+		if (fill_desired_freqs(efreqs, wav))
+			goto free_efreqs;
+	}
+
+	if (fit_memory(in, opts, data_sz, &win, wav, &nranges))
+		goto free_efreqs;
+
+	tables = tables_get(cache, win.size, opts->precision);
+	if (!tables)
+		goto free_efreqs;
+
+	if (analysis_init(&an, &win, gate, -1, tables, wav))
+		goto put_tables;
+
+	/* A followed file may be interrupted before its announced end, the
+	 * windows are validated as the data comes.
+	 */
+	if (opts->follow) {
+		wav->samples_per_chan = 0;
+		fl.wav = wav;
+		fl.win = &win;
+		fl.efreqs = efreqs;
+		fl.start_s = opts->start_s;
+		an.batch.report = follow_report;
+		an.batch.priv = &fl;
+	}
+
+	data = input_mapped(in, data_sz);
+	if (data && nranges > 1) {
+		if (analyze_ranges(&an, nranges, data, data_sz, &win, gate,
+				   tables, wav, opts->pool))
+			goto cleanup_analysis;
+	} else {
+		frame_sz = wav->channels * wav->bits_per_sample / 8;
+		if (input_start(in, win.offset * frame_sz, win.slide * frame_sz,
+				data_sz))
+			goto cleanup_analysis;
+
+		for (;;) {
+			t = stats_now(&stats);
+			more = input_next(in, &chunk, &sz);
+			stats_stage(&stats, STAGE_READ, t);
+			if (more <= 0)
+				break;
+
+			stream_feed(&an.st, chunk, sz / frame_sz);
+			input_release(in);
+		}
+
+		input_stop(in);
+		if (more < 0)
+			goto cleanup_analysis;
+
+		analysis_finish(&an, wav);
+	}
+
+	cfreqs = an.cfreqs;
+	ncfreqs = an.ncfreqs;
+	thresholds = an.thresholds;
+	duplicates = an.st.duplicates;
+	for (c = 0; c < wav->channels; c++) {
+		if (duplicates[c] >= 0)
+			continue;
+
+		nwindows += an.st.nwindows;
+		ngated += an.st.ngated[c];
+	}
+
+	fprintf(diag(), "Gated windows: %u/%u\n\n", ngated, nwindows);
+
+	t = stats_now(&stats);
+
+	/* The user did not require frequency comparisons, just print the analysis */
+	if (!wav->freqs_per_chan) {
+		for (c = 0; c < wav->channels; c++) {
+			fprintf(out, "Frequencies found on channel %d (", c);
+			if (duplicates[c] >= 0)
+				fprintf(out, "duplicate of channel %d, ", duplicates[c]);
+			fprintf(out, "max threshold: %.1f):\n", thresholds[c]);
+			if (!ncfreqs[c])
+				fprintf(out, "None.\n");
+			for (i = 0; i < ncfreqs[c]; i++)
+				fprintf(out, "* %u Hz\n", cfreqs[c][i]);
+		}
+
+		stats_stage(&stats, STAGE_REPORT, t);
+		ret = 0;
+		goto cleanup_analysis;
+	}
+
+	/* Compare computed and expected frequencies */
+	for (c = 0; c < wav->channels; c++) {
+		unsigned int found = 0, i;
+		bool is_listed;
+
+		fprintf(out, "Frequencies expected on channel %d (%s", c,
+		       !ncfreqs[c] ? "empty, " : "");
+		if (duplicates[c] >= 0)
+			fprintf(out, "duplicate of channel %d, ", duplicates[c]);
+		fprintf(out, "max threshold: %.1f):\n", thresholds[c]);
+		for (i = 0; i < wav->freqs_per_chan; i++) {
+			is_listed = freq_is_listed(cfreqs[c], ncfreqs[c], efreqs[c][i]);
+			fprintf(out, "* %u/ %u Hz: ", i, efreqs[c][i]);
+			if (!is_listed) {
+				fprintf(out, "KO\n");
+			} else {
+				int diff = cfreqs[c][i] - efreqs[c][i];
+				fprintf(out, "ok");
+				if (diff)
+					fprintf(out, " (%d Hz)", diff);
+				fprintf(out, "\n");
+				found++;
+			}
+		}
+
+		if (found < ncfreqs[c]) {
+			fprintf(out, "Frequencies *not* expected on channel %d:\n", c);
+			for (i = 0; i < ncfreqs[c]; i++) {
+				is_listed = freq_is_listed(efreqs[c], wav->freqs_per_chan,
+							   cfreqs[c][i]);
+				if (!is_listed)
+					fprintf(out, "*    %u Hz: spurious\n", cfreqs[c][i]);
+			}
+		}
+	}
+	fprintf(out, "\n");
+
+	stats_stage(&stats, STAGE_REPORT, t);
+	ret = 0;
+cleanup_analysis:
+	analysis_cleanup(&an, wav);
+put_tables:
+	tables_put(cache, tables);
+free_efreqs:
+	if (efreqs) {
+		free_array((void **)efreqs, wav->channels);
+		free(efreqs);
+	}
+
+	return ret;
+}
+
+/* Requests are the command line arguments of the client, each one ended by a
+ * NUL byte, the last one being empty. Without a path, the audio follows.
+ */
+#define DAEMON_MAX_ARGS 64
+#define DAEMON_MAX_ARG_LEN 4096
+
+/* The options are parsed with getopt() one request at a time, and the
+ * statistics are global: requests for them exclude the others.
+ */
+static pthread_mutex_t daemon_args_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_rwlock_t daemon_stats_lock = PTHREAD_RWLOCK_INITIALIZER;
+
+static char **daemon_read_args(struct input *in, char *tool_name, int *argc)
+{
+	char **argv, *arg;
+	size_t len;
+	int n = 1;
+
+	argv = calloc(DAEMON_MAX_ARGS + 1, sizeof(*argv));
+	if (!argv)
+		return NULL;
+
+	argv[0] = tool_name;
+	for (;;) {
+		arg = malloc(DAEMON_MAX_ARG_LEN);
+		if (!arg)
+			goto free_args;
+
+		for (len = 0; len < DAEMON_MAX_ARG_LEN; len++) {
+			if (input_read(in, &arg[len], 1) != 1) {
+				free(arg);
+				goto free_args;
+			}
+			if (!arg[len])
+				break;
+		}
+
+		if (len == DAEMON_MAX_ARG_LEN || (len && n == DAEMON_MAX_ARGS)) {
+			free(arg);
+			goto free_args;
+		}
+
+		if (!len) {
+			free(arg);
+			break;
+		}
+
+		argv[n++] = arg;
+	}
+
+	*argc = n;
+
+	return argv;
+
+free_args:
+	while (--n > 0)
+		free(argv[n]);
+	free(argv);
+
+	return NULL;
+}
+
+static void daemon_free_args(char **argv, int argc)
+{
+	while (--argc > 0)
+		free(argv[argc]);
+	free(argv);
+}
+
+/* Run one request, the diagnostics go to the standard error */
+static int daemon_analyze(struct input *conn, int passed, char *tool_name,
+			  struct tables_cache *cache, struct pool *pool,
+			  FILE *out)
+{
+	struct analyzer_opts opts = {
+		.gate_db = 0,
+		.jobs = 1,
+		.fd = -1,
+	};
+	struct audio wav = {
+		.freqs_per_chan = 0,
+	};
+	struct input file;
+	bool exclusive;
+	char **argv;
+	int argc, ret = -1;
+
+	argv = daemon_read_args(conn, tool_name, &argc);
+	if (!argv) {
+		fprintf(diag(), "Malformed request\n");
+		goto close_passed;
+	}
+
+	parse_precision(DEFAULT_PRECISION, &opts.precision);
+	pthread_mutex_lock(&daemon_args_lock);
+	optind = 0;
+	ret = parse_args(argc, argv, &wav, &opts);
+	pthread_mutex_unlock(&daemon_args_lock);
+	if (ret) {
+		ret = -1;
+		goto free_args;
+	}
+
+	ret = -1;
+	if (opts.daemon || opts.follow || opts.watch || opts.npaths > 1 ||
+	    opts.manifest || opts.merge || opts.trace) {
+		fprintf(diag(), "Not available through the daemon\n");
+		goto free_args;
+	}
+
+	/* The ranges of the windows run on the workers of the daemon */
+	opts.pool = pool;
+
+	/* Statistics of this request only, printed with its diagnostics */
+	exclusive = opts.stats != STATS_OFF || opts.perf_counters;
+	if (exclusive) {
+		pthread_rwlock_wrlock(&daemon_stats_lock);
+		stats_start(&stats, opts.stats, false, opts.perf_counters);
+	} else {
+		pthread_rwlock_rdlock(&daemon_stats_lock);
+	}
+
+	/* The descriptor of the client was received, whatever its number */
+	if (opts.fd >= 0) {
+		if (passed < 0) {
+			fprintf(diag(), "No descriptor received\n");
+			goto unlock;
+		}
+
+		ret = input_open_fd(&file, passed);
+		passed = -1;
+		if (ret)
+			goto unlock;
+	} else if (!opts.path) {
+		ret = analyze(conn, &opts, &wav, cache, out);
+		goto unlock;
+	} else if (input_open(&file, opts.path, false)) {
+		goto unlock;
+	}
+
+	ret = analyze(&file, &opts, &wav, cache, out);
+	input_close(&file);
+
+unlock:
+	if (exclusive) {
+		stats_print(&stats, diag(), "wav-analyzer", COUNTER_BYTES,
+			    COUNTER_WINDOWS);
+		stats_stop(&stats);
+	}
+	pthread_rwlock_unlock(&daemon_stats_lock);
+free_args:
+	daemon_free_args(argv, argc);
+close_passed:
+	if (passed >= 0)
+		close(passed);
+
+	return ret;
+}
+
+/* Answer with the status and the sizes of the report and of the diagnostics,
+ * followed by both.
+ */
+static int daemon_serve(int fd, char *tool_name, struct tables_cache *cache,
+			struct pool *pool)
+{
+	char hdr[64], *report = NULL, buf[4096];
+	size_t report_len = 0, log_len, len;
+	FILE *out, *log, *prev;
+	int passed, ret = -1;
+	struct input conn;
+
+	log = tmpfile();
+	if (!log)
+		return -1;
+
+	out = open_memstream(&report, &report_len);
+	if (!out)
+		goto close_log;
+
+	/* The request starts with the descriptor to analyze, if any */
+	if (socket_recv_fd(fd, &passed))
+		goto close_out;
+
+	if (input_open_fd(&conn, dup(fd))) {
+		if (passed >= 0)
+			close(passed);
+		goto close_out;
+	}
+
+	prev = diag_redirect(log);
+	ret = daemon_analyze(&conn, passed, tool_name, cache, pool, out);
+	diag_redirect(prev);
+	input_close(&conn);
+
+	fflush(out);
+	log_len = ftell(log);
+	rewind(log);
+	snprintf(hdr, sizeof(hdr), "%d %zu %zu\n", ret, report_len, log_len);
+	if (socket_write(fd, hdr, strlen(hdr)) ||
+	    socket_write(fd, report, report_len))
+		goto close_out;
+
+	while ((len = fread(buf, 1, sizeof(buf), log)))
+		if (socket_write(fd, buf, len))
+			break;
+
+close_out:
+	fclose(out);
+	free(report);
+close_log:
+	fclose(log);
+
+	return ret;
+}
+
+/* Client served by a worker of the daemon */
+struct daemon_task {
+	int conn;
+	char *tool_name;
+	struct tables_cache *cache;
+	struct pool *pool;
+};
+
+static void daemon_task(void *arg)
+{
+	struct daemon_task *task = arg;
+
+	daemon_serve(task->conn, task->tool_name, task->cache, task->pool);
+	close(task->conn);
+	free(task);
+}
+
+/* Serve the clients on a pool of workers, so that a slow client does not hold
+ * the others up, while the ranges of their analyses run on a second pool. Both
+ * pools, the FFT plans and the window tables of the previous analyses remain
+ * ready for the next ones.
+ */
+static int daemon_run(const char *path, char *tool_name, unsigned int jobs)
+{
+	struct tables_cache cache = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	struct pool *clients, *ranges;
+	struct daemon_task *task;
+	int fd, conn;
+
+	fd = socket_listen(path);
+	if (fd < 0)
+		return -1;
+
+	clients = pool_create(DAEMON_CLIENTS);
+	if (!clients)
+		goto close_fd;
+
+	ranges = pool_create(jobs);
+	if (!ranges)
+		goto destroy_clients;
+
+	fprintf(diag(), "Serving analyses on %s\n", path);
+
+	for (;;) {
+		conn = accept(fd, NULL, NULL);
+		if (conn < 0 && errno == EINTR)
+			continue;
+		if (conn < 0) {
+			fprintf(diag(), "Cannot accept connections: %s\n",
+				strerror(errno));
+			break;
+		}
+
+		task = malloc(sizeof(*task));
+		if (!task) {
+			close(conn);
+			continue;
+		}
+
+		task->conn = conn;
+		task->tool_name = tool_name;
+		task->cache = &cache;
+		task->pool = ranges;
+		if (pool_submit(clients, daemon_task, task)) {
+			close(conn);
+			free(task);
+		}
+	}
+
+	/* The clients use the workers of the ranges */
+	pool_destroy(clients);
+	pool_destroy(ranges);
+	tables_cache_cleanup(&cache);
+	goto close_fd;
+
+destroy_clients:
+	pool_destroy(clients);
+close_fd:
+	close(fd);
+
+	return -1;
+}
+
+static void client_copy(FILE *from, FILE *to, size_t len)
+{
+	char buf[4096];
+	size_t n;
+
+	for (; len; len -= n) {
+		n = fread(buf, 1, len < sizeof(buf) ? len : sizeof(buf), from);
+		if (!n)
+			break;
+		fwrite(buf, 1, n, to);
+	}
+}
+
+/* Forward the descriptor to analyze if any, the arguments, with an absolute
+ * path, and the standard input when there is neither, then print what the
+ * daemon answers.
+ */
+static int client_run(const struct analyzer_opts *opts, int argc, char *argv[])
+{
+	size_t report_len, log_len;
+	char *path = NULL, buf[4096];
+	ssize_t rd;
+	FILE *resp;
+	int fd, i, ret = -1;
+
+	fd = socket_connect(opts->connect);
+	if (fd < 0)
+		return -1;
+
+	if (opts->path)
+		path = realpath(opts->path, NULL);
+
+	if (socket_send_fd(fd, opts->fd))
+		goto close_fd;
+
+	for (i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+
+		if (path && argv[i] == opts->path)
+			arg = path;
+		if (socket_write(fd, arg, strlen(arg) + 1))
+			goto close_fd;
+	}
+
+	if (socket_write(fd, "", 1))
+		goto close_fd;
+
+	/* The daemon may stop reading early, eg. on a malformed header */
+	while (!opts->path && opts->fd < 0 &&
+	       (rd = read(STDIN_FILENO, buf, sizeof(buf))) > 0)
+		if (socket_write(fd, buf, rd))
+			break;
+
+	shutdown(fd, SHUT_WR);
+
+	resp = fdopen(fd, "r");
+	if (!resp)
+		goto close_fd;
+
+	fd = -1;
+	if (fscanf(resp, "%d %zu %zu\n", &ret, &report_len, &log_len) != 3) {
+		fprintf(diag(), "Malformed answer from the daemon\n");
+		ret = -1;
+		goto close_resp;
+	}
+
+	client_copy(resp, stdout, report_len);
+	client_copy(resp, stderr, log_len);
+
+close_resp:
+	fclose(resp);
+close_fd:
+	if (fd >= 0)
+		close(fd);
+	free(path);
+
+	return ret;
+}
+
+/* A capture dropped in the watched directory, analyzed by a worker */
+struct watch_task {
+	const struct analyzer_opts *opts;
+	const struct audio *wav;
+	struct tables_cache *cache;
+	char *path;
+};
+
+static volatile sig_atomic_t watch_stopped;
+
+static void watch_interrupt(int sig)
+{
+	(void)sig;
+	watch_stopped = 1;
+}
+
+/* The report is written next to the capture, under a temporary name until
+ * it is complete.
+ */
+static void watch_analyze(void *arg)
+{
+	struct watch_task *task = arg;
+	struct audio wav = *task->wav;
+	size_t len = strlen(task->path) + sizeof(".result.tmp");
+	char *result, *tmp;
+	struct input in;
+	int ret = -1;
+	FILE *out;
+
+	result = malloc(len);
+	tmp = malloc(len);
+	if (!result || !tmp)
+		goto free_task;
+
+	snprintf(result, len, "%s.result", task->path);
+	snprintf(tmp, len, "%s.result.tmp", task->path);
+	out = fopen(tmp, "w");
+	if (!out) {
+		fprintf(diag(), "Cannot create %s\n", tmp);
+		goto free_task;
+	}
+
+	if (!input_open(&in, task->path, false)) {
+		ret = analyze(&in, task->opts, &wav, task->cache, out);
+		input_close(&in);
+	}
+
+	if (ret)
+		fprintf(out, "Analysis failed\n");
+
+	if (fclose(out) || rename(tmp, result)) {
+		fprintf(diag(), "Cannot write %s\n", result);
+		ret = -1;
+	}
+
+	printf("%s: %s\n", task->path, ret ? "failed" : "done");
+	fflush(stdout);
+
+free_task:
+	free(tmp);
+	free(result);
+	free(task->path);
+	free(task);
+}
+
+static bool watch_is_capture(const char *name)
+{
+	size_t len = strlen(name);
+
+	return name[0] != '.' && len > 4 && !strcasecmp(name + len - 4, ".wav");
+}
+
+static int watch_submit(struct pool *pool, struct watch_task *proto,
+			const char *dir, const char *name)
+{
+	size_t len = strlen(dir) + strlen(name) + 2;
+	struct watch_task *task;
+
+	task = malloc(sizeof(*task));
+	if (!task)
+		return -1;
+
+	*task = *proto;
+	task->path = malloc(len);
+	if (!task->path) {
+		free(task);
+		return -1;
+	}
+
+	snprintf(task->path, len, "%s/%s", dir, name);
+	if (pool_submit(pool, watch_analyze, task)) {
+		free(task->path);
+		free(task);
+		return -1;
+	}
+
+	return 0;
+}
+
+/* Captures already there when starting and without result are analyzed
+ * first.
+ */
+static void watch_scan(struct pool *pool, struct watch_task *proto,
+		       const char *dir)
+{
+	char result[PATH_MAX];
+	struct dirent *ent;
+	DIR *d;
+
+	d = opendir(dir);
+	if (!d)
+		return;
+
+	while ((ent = readdir(d))) {
+		if (!watch_is_capture(ent->d_name))
+			continue;
+
+		snprintf(result, sizeof(result), "%s/%s.result", dir,
+			 ent->d_name);
+		if (!access(result, F_OK))
+			continue;
+
+		watch_submit(pool, proto, dir, ent->d_name);
+	}
+
+	closedir(d);
+}
+
+/* Analyze the captures once their writer closes them or moves them in the
+ * directory, until SIGINT or SIGTERM. The workers of the pool share the
+ * FFT tables.
+ */
+static int watch_run(const char *dir, const struct analyzer_opts *opts,
+		     const struct audio *wav)
+{
+	char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	struct tables_cache cache = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	struct analyzer_opts task_opts = *opts;
+	struct sigaction sa = {
+		.sa_handler = watch_interrupt,
+	};
+	struct watch_task proto = {
+		.opts = &task_opts,
+		.wav = wav,
+		.cache = &cache,
+	};
+	const struct inotify_event *ev;
+	struct pool *pool;
+	int notify, ret = -1;
+	ssize_t len, pos;
+
+	notify = inotify_init1(IN_CLOEXEC);
+	if (notify < 0 ||
+	    inotify_add_watch(notify, dir, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+		fprintf(diag(), "Cannot watch %s\n", dir);
+		goto close_notify;
+	}
+
+	/* The ranges of the captures are tasks of the pool too */
+	pool = pool_create(opts->jobs);
+	if (!pool)
+		goto close_notify;
+
+	task_opts.pool = pool;
+	sigaction(SIGINT, &sa, NULL);
+	sigaction(SIGTERM, &sa, NULL);
+
+	watch_scan(pool, &proto, dir);
+	fprintf(diag(), "Watching %s\n", dir);
+
+	while (!watch_stopped) {
+		len = read(notify, buf, sizeof(buf));
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len <= 0)
+			break;
+
+		for (pos = 0; pos < len; pos += sizeof(*ev) + ev->len) {
+			ev = (const struct inotify_event *)&buf[pos];
+			if (ev->len && watch_is_capture(ev->name))
+				watch_submit(pool, &proto, dir, ev->name);
+		}
+	}
+
+	/* Pending captures are still analyzed */
+	pool_wait(pool);
+	pool_destroy(pool);
+	tables_cache_cleanup(&cache);
+	ret = watch_stopped ? 0 : -1;
+
+close_notify:
+	if (notify >= 0)
+		close(notify);
+
+	return ret;
+}
+
+/* One of the files given on the command line, analyzed by a worker which
+ * shares the ranges of its windows with the others.
+ */
+struct batch_file {
+	const struct analyzer_opts *opts;
+	const struct audio *wav;
+	struct tables_cache *cache;
+	const char *path;
+	char *report;
+	size_t report_len;
+	int ret;
+};
+
+static void batch_analyze(void *arg)
+{
+	struct batch_file *file = arg;
+	struct audio wav = *file->wav;
+	struct input in;
+	FILE *out;
+
+	out = open_memstream(&file->report, &file->report_len);
+	if (!out)
+		return;
+
+	if (!input_open(&in, file->path, false)) {
+		file->ret = analyze(&in, file->opts, &wav, file->cache, out);
+		input_close(&in);
+	}
+
+	fclose(out);
+}
+
+/* Analyze files on a pool of workers, the reports are kept in memory */
+static struct batch_file *batch_analyze_files(const struct analyzer_opts *opts,
+					      const struct audio *wav,
+					      char *const *paths,
+					      unsigned int npaths)
+{
+	struct tables_cache cache = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	struct analyzer_opts file_opts = *opts;
+	struct batch_file *files;
+	struct pool *pool;
+	unsigned int i;
+
+	files = calloc(npaths ? npaths : 1, sizeof(*files));
+	if (!files)
+		return NULL;
+
+	pool = pool_create(opts->jobs);
+	if (!pool) {
+		free(files);
+		return NULL;
+	}
+
+	file_opts.pool = pool;
+	for (i = 0; i < npaths; i++) {
+		files[i].opts = &file_opts;
+		files[i].wav = wav;
+		files[i].cache = &cache;
+		files[i].path = paths[i];
+		files[i].ret = -1;
+		pool_submit(pool, batch_analyze, &files[i]);
+	}
+
+	pool_wait(pool);
+	pool_destroy(pool);
+	tables_cache_cleanup(&cache);
+
+	return files;
+}
+
+static void batch_free(struct batch_file *files, unsigned int nfiles)
+{
+	unsigned int i;
+
+	for (i = 0; i < nfiles; i++)
+		free(files[i].report);
+	free(files);
+}
+
+/* Print the reports in the order of the files, then the failures */
+static int batch_print(const struct batch_file *files, unsigned int nfiles)
+{
+	unsigned int i, nfailed = 0;
+
+	for (i = 0; i < nfiles; i++) {
+		printf("File %s:\n", files[i].path);
+		if (files[i].report)
+			fwrite(files[i].report, 1, files[i].report_len, stdout);
+		if (files[i].ret)
+			nfailed++;
+	}
+
+	printf("Analyzed %u files, %u failed%s\n", nfiles, nfailed,
+	       nfailed ? ":" : "");
+	for (i = 0; i < nfiles; i++)
+		if (files[i].ret)
+			printf("* %s\n", files[i].path);
+
+	return nfailed ? -1 : 0;
+}
+
+static int batch_run(const struct analyzer_opts *opts, const struct audio *wav,
+		     char *const *paths, unsigned int npaths)
+{
+	struct batch_file *files;
+	int ret;
+
+	files = batch_analyze_files(opts, wav, paths, npaths);
+	if (!files)
+		return -1;
+
+	ret = batch_print(files, npaths);
+	batch_free(files, npaths);
+
+	return ret;
+}
+
+/* A campaign manifest lists one file per line, relative paths being relative
+ * to the manifest. Empty lines and lines starting with '#' are ignored.
+ */
+static char **manifest_load(const char *manifest, unsigned int *npaths)
+{
+	const char *slash = strrchr(manifest, '/');
+	int dir_len = slash ? slash - manifest + 1 : 0;
+	char **paths = NULL, **grown, *line = NULL;
+	unsigned int n = 0, size = 0;
+	size_t line_sz = 0, len;
+	ssize_t rd;
+	FILE *f;
+
+	f = fopen(manifest, "r");
+	if (!f) {
+		fprintf(diag(), "Cannot open %s\n", manifest);
+		return NULL;
+	}
+
+	while ((rd = getline(&line, &line_sz, f)) >= 0) {
+		if (rd && line[rd - 1] == '\n')
+			line[--rd] = '\0';
+		if (!rd || line[0] == '#')
+			continue;
+
+		if (n == size) {
+			size = size ? 2 * size : 64;
+			grown = realloc(paths, size * sizeof(*paths));
+			if (!grown)
+				goto free_paths;
+			paths = grown;
+		}
+
+		len = dir_len + rd + 1;
+		paths[n] = malloc(len);
+		if (!paths[n])
+			goto free_paths;
+
+		if (line[0] == '/')
+			snprintf(paths[n], len, "%s", line);
+		else
+			snprintf(paths[n], len, "%.*s%s", dir_len, manifest, line);
+		n++;
+	}
+
+	if (!n) {
+		fprintf(diag(), "Empty manifest: %s\n", manifest);
+		goto free_paths;
+	}
+
+	free(line);
+	fclose(f);
+	*npaths = n;
+
+	return paths;
+
+free_paths:
+	while (n)
+		free(paths[--n]);
+	free(paths);
+	free(line);
+	fclose(f);
+
+	return NULL;
+}
+
+static void manifest_free(char **paths, unsigned int npaths)
+{
+	while (npaths)
+		free(paths[--npaths]);
+	free(paths);
+}
+
+/* Longest processing time first: the files are taken from the biggest to the
+ * smallest and each one goes to the shard with the least data so far. All
+ * the shards compute the same split, file sizes being the same on all hosts.
+ */
+struct shard_file {
+	unsigned int index;
+	off_t size;
+};
+
+static int shard_file_cmp(const void *a, const void *b)
+{
+	const struct shard_file *fa = a, *fb = b;
+
+	if (fa->size != fb->size)
+		return fa->size < fb->size ? 1 : -1;
+
+	return fa->index < fb->index ? -1 : fa->index > fb->index;
+}
+
+static int shard_select(char *const *paths, unsigned int npaths,
+			unsigned int shard, unsigned int nshards,
+			unsigned int *selected, unsigned int *nselected)
+{
+	struct shard_file *files;
+	unsigned int i, s, best;
+	off_t *loads;
+	struct stat st;
+
+	files = calloc(npaths, sizeof(*files));
+	loads = calloc(nshards, sizeof(*loads));
+	if (!files || !loads) {
+		free(files);
+		free(loads);
+		return -1;
+	}
+
+	/* Missing files weigh nothing, their analysis reports the error */
+	for (i = 0; i < npaths; i++) {
+		files[i].index = i;
+		files[i].size = stat(paths[i], &st) ? 0 : st.st_size;
+	}
+
+	qsort(files, npaths, sizeof(*files), shard_file_cmp);
+
+	*nselected = 0;
+	for (i = 0; i < npaths; i++) {
+		for (best = 0, s = 1; s < nshards; s++)
+			if (loads[s] < loads[best])
+				best = s;
+
+		loads[best] += files[i].size;
+		if (best == shard)
+			selected[(*nselected)++] = files[i].index;
+	}
+
+	free(files);
+	free(loads);
+
+	return 0;
+}
+
+static int shard_index_cmp(const void *a, const void *b)
+{
+	unsigned int ia = *(const unsigned int *)a, ib = *(const unsigned int *)b;
+
+	return ia < ib ? -1 : ia > ib;
+}
+
+/* A partial result starts with the shard and the number of files of the
+ * campaign, followed by the reports of the shard, each one preceded by the
+ * index of the file in the manifest, the status and the size of the report.
+ */
+static int shard_run(const struct analyzer_opts *opts, const struct audio *wav)
+{
+	unsigned int npaths, nselected, *selected, i;
+	char **paths, **shard_paths = NULL;
+	struct batch_file *files = NULL;
+	int ret = -1;
+
+	paths = manifest_load(opts->manifest, &npaths);
+	if (!paths)
+		return -1;
+
+	selected = calloc(npaths, sizeof(*selected));
+	shard_paths = calloc(npaths, sizeof(*shard_paths));
+	if (!selected || !shard_paths)
+		goto free_selected;
+
+	if (shard_select(paths, npaths, opts->shard, opts->nshards, selected,
+			 &nselected))
+		goto free_selected;
+
+	/* Analyze the files in the order of the manifest */
+	qsort(selected, nselected, sizeof(*selected), shard_index_cmp);
+	for (i = 0; i < nselected; i++)
+		shard_paths[i] = paths[selected[i]];
+
+	fprintf(diag(), "Shard %u/%u: %u of %u files\n", opts->shard,
+		opts->nshards, nselected, npaths);
+
+	files = batch_analyze_files(opts, wav, shard_paths, nselected);
+	if (!files)
+		goto free_selected;
+
+	printf("Partial %u/%u of %u files\n", opts->shard, opts->nshards, npaths);
+	for (i = 0; i < nselected; i++) {
+		printf("File %u %d %zu %s\n", selected[i], files[i].ret,
+		       files[i].report_len, files[i].path);
+		if (files[i].report)
+			fwrite(files[i].report, 1, files[i].report_len, stdout);
+	}
+
+	ret = fflush(stdout) ? -1 : 0;
+	batch_free(files, nselected);
+
+free_selected:
+	free(shard_paths);
+	free(selected);
+	manifest_free(paths, npaths);
+
+	return ret;
+}
+
+/* Combine the partial results of all the shards of a campaign into the
+ * report of a batch, in the order of the manifest.
+ */
+static int merge_run(char *const *partials, unsigned int npartials)
+{
+	unsigned int shard, nshards = 0, nfiles = 0, n, index, i;
+	struct batch_file *files = NULL;
+	bool *seen = NULL;
+	char **names = NULL;
+	char *line = NULL;
+	size_t line_sz = 0, len;
+	int status, ret = -1;
+	ssize_t rd;
+	FILE *f;
+
+	for (i = 0; i < npartials; i++) {
+		f = fopen(partials[i], "r");
+		if (!f) {
+			fprintf(diag(), "Cannot open %s\n", partials[i]);
+			goto free_files;
+		}
+
+		if (fscanf(f, "Partial %u/%u of %u files\n", &shard, &n,
+			   &index) != 3 || shard >= n || !index ||
+		    (nshards && (n != nshards || index != nfiles))) {
+			fprintf(diag(), "Malformed or foreign partial result: %s\n",
+				partials[i]);
+			goto close_partial;
+		}
+
+		if (!nshards) {
+			nshards = n;
+			nfiles = index;
+			files = calloc(nfiles, sizeof(*files));
+			names = calloc(nfiles, sizeof(*names));
+			seen = calloc(nshards, sizeof(*seen));
+			if (!files || !names || !seen)
+				goto close_partial;
+		}
+
+		if (seen[shard]) {
+			fprintf(diag(), "Shard %u given twice\n", shard);
+			goto close_partial;
+		}
+		seen[shard] = true;
+
+		while (fscanf(f, "File %u %d %zu ", &index, &status, &len) == 3) {
+			rd = getline(&line, &line_sz, f);
+			if (index >= nfiles || names[index] || rd <= 1)
+				goto malformed;
+
+			line[rd - 1] = '\0';
+			files[index].report_len = len;
+			files[index].ret = status;
+			files[index].path = names[index] = strdup(line);
+			files[index].report = malloc(files[index].report_len + 1);
+			if (!names[index] || !files[index].report ||
+			    fread(files[index].report, 1, files[index].report_len,
+				  f) != files[index].report_len)
+				goto malformed;
+		}
+
+		if (!feof(f))
+			goto malformed;
+
+		fclose(f);
+	}
+
+	for (shard = 0; shard < nshards; shard++) {
+		if (!seen[shard]) {
+			fprintf(diag(), "Missing shard %u/%u\n", shard, nshards);
+			goto free_files;
+		}
+	}
+
+	for (index = 0; index < nfiles; index++) {
+		if (!names[index]) {
+			fprintf(diag(), "Missing file %u of the campaign\n", index);
+			goto free_files;
+		}
+	}
+
+	ret = batch_print(files, nfiles);
+	goto free_files;
+
+malformed:
+	fprintf(diag(), "Malformed partial result: %s\n", partials[i]);
+close_partial:
+	fclose(f);
+free_files:
+	if (files)
+		batch_free(files, nfiles);
+	if (names)
+		manifest_free(names, nfiles);
+	free(seen);
+	free(line);
+
+	return ret;
+}
+
+static int manifest_run(const struct analyzer_opts *opts,
+			const struct audio *wav)
+{
+	unsigned int npaths;
+	char **paths;
+	int ret;
+
+	paths = manifest_load(opts->manifest, &npaths);
+	if (!paths)
+		return -1;
+
+	ret = batch_run(opts, wav, paths, npaths);
+	manifest_free(paths, npaths);
+
+	return ret;
+}
+
+/* Read the *.wav file from the argument, a descriptor or the standard input */
+static int single_run(const struct analyzer_opts *opts, struct audio *wav)
+{
+	struct sigaction sa = {
+		.sa_handler = follow_interrupt,
+	};
+	struct tables_cache cache = {
+		.lock = PTHREAD_MUTEX_INITIALIZER,
+	};
+	struct input in;
+	int ret;
+
+	if (opts->fd >= 0) {
+		if (input_open_fd(&in, opts->fd))
+			return -1;
+	} else if (input_open(&in, opts->path, opts->follow)) {
+		return -1;
+	}
+
+	/* Stop following the file on user request, still reporting */
+	if (opts->follow) {
+		followed = &in;
+		sigaction(SIGINT, &sa, NULL);
+		sigaction(SIGTERM, &sa, NULL);
+	}
+
+	ret = analyze(&in, opts, wav, &cache, stdout);
+
+	tables_cache_cleanup(&cache);
+	input_close(&in);
+
+	return ret;
+}
+
+int main(int argc, char *argv[])
+{
+	const struct audio wav = {
+		.freqs_per_chan = 0,
+	};
+	struct analyzer_opts opts = {
+		.gate_db = 0,
+		.jobs = 1,
+		.fd = -1,
+	};
+	int ret;
+
+	/* Parse args */
+	if (parse_precision(DEFAULT_PRECISION, &opts.precision)) {
+		fprintf(diag(), "Unknown default precision: %s\n", DEFAULT_PRECISION);
+		return -1;
+	}
+
+	if (parse_args(argc, argv, (struct audio *)&wav, &opts))
+		return -1;
+
+	if (kernels_init())
+		return -1;
+
+	if (opts.daemon)
+		return daemon_run(opts.daemon, argv[0], opts.jobs);
+
+	/* The daemon gathers the statistics of the analysis, the memory of
+	 * this thin client would not tell anything about it.
+	 */
+	if (opts.connect)
+		return client_run(&opts, argc, argv);
+
+	stats_start(&stats, opts.stats, opts.trace != NULL, opts.perf_counters);
+
+	if (opts.watch)
+		ret = watch_run(opts.watch, &opts, &wav);
+	else if (opts.merge)
+		ret = merge_run(opts.paths, opts.npaths);
+	else if (opts.nshards)
+		ret = shard_run(&opts, &wav);
+	else if (opts.manifest)
+		ret = manifest_run(&opts, &wav);
+	else if (opts.npaths > 1)
+		ret = batch_run(&opts, &wav, opts.paths, opts.npaths);
+	else
+		ret = single_run(&opts, (struct audio *)&wav);
+
+	stats_print(&stats, diag(), "wav-analyzer", COUNTER_BYTES,
+		    COUNTER_WINDOWS);
+	if (opts.trace && stats_trace_dump(&stats, opts.trace))
+		ret = -1;
+
+	mem_report(diag());
 
 	return ret;
 }
@@ -0,0 +1,276 @@
+#!/bin/sh
+# SPDX-License-Identifier: GPL-2.0+
+#
+# Checks of the tools on generated files, run by "make check". RUNNER prefixes
+# the tools, eg. with qemu-user when cross compiling.
+
+RUNNER=${RUNNER:-}
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+failures=0
+
+gen()
+{
+	$RUNNER ./wav-generator "$@" 2>/dev/null
+}
+
+analyze()
+{
+	$RUNNER ./wav-analyzer "$@"
+}
+
+# Summary of a followed analysis, without the verdicts per window
+summary()
+{
+	grep -v '^[0-9.]*s: channel'
+}
+
+# Little endian fields of handmade headers
+byte()
+{
+	printf "\\$(printf %o "$1")"
+}
+
+le16()
+{
+	byte $(($1 & 255))
+	byte $(($1 >> 8 & 255))
+}
+
+le32()
+{
+	le16 $(($1 & 65535))
+	le16 $(($1 >> 16 & 65535))
+}
+
+result()
+{
+	name=$1
+	shift
+
+	if "$@"; then
+		echo "$name: ok"
+	else
+		echo "$name: FAILED"
+		failures=$((failures + 1))
+	fi
+}
+
+# A followed file completed by a second writer is fully analyzed
+follow_completed()
+{
+	head -c 200000 "$dir/full.wav" > "$dir/grow.wav"
+	timeout 30 $RUNNER ./wav-analyzer --follow "$dir/grow.wav" \
+		> "$dir/grow.out" 2>/dev/null &
+	pid=$!
+	sleep 1
+	tail -c +200001 "$dir/full.wav" >> "$dir/grow.wav"
+	wait $pid || return 1
+
+	summary < "$dir/grow.out" | cmp -s - "$dir/full.out"
+}
+
+# A followed file whose writer stops short of its announced size is partial
+follow_truncated()
+{
+	head -c 200000 "$dir/full.wav" > "$dir/trunc.wav"
+	timeout 30 $RUNNER ./wav-analyzer --follow "$dir/trunc.wav" \
+		> /dev/null 2> "$dir/trunc.err" &
+	pid=$!
+	sleep 1
+	tail -c +200001 "$dir/full.wav" | head -c 100000 >> "$dir/trunc.wav"
+	wait $pid
+	rc=$?
+
+	[ $rc -ne 0 ] && [ $rc -ne 124 ] &&
+		grep -q "Partial audio content" "$dir/trunc.err"
+}
+
+follow_pipe_completed()
+{
+	cat "$dir/full.wav" | timeout 30 $RUNNER ./wav-analyzer --follow \
+		2>/dev/null | summary | cmp -s - "$dir/full.out"
+}
+
+follow_pipe_truncated()
+{
+	head -c 200000 "$dir/full.wav" |
+		timeout 30 $RUNNER ./wav-analyzer --follow > /dev/null 2>&1
+	rc=$?
+
+	[ $rc -ne 0 ] && [ $rc -ne 124 ]
+}
+
+# Clients of a daemon are served at once, a slow one not holding the others
+daemon_clients()
+{
+	sock=$dir/daemon.sock
+	$RUNNER ./wav-analyzer --daemon="$sock" -j 2 2>/dev/null &
+	daemon=$!
+	for i in $(seq 50); do
+		[ -S "$sock" ] && break
+		sleep 0.1
+	done
+
+	(head -c 44 "$dir/full.wav"; sleep 2; tail -c +45 "$dir/full.wav") |
+		analyze --connect="$sock" > "$dir/slow.out" 2>/dev/null &
+	slow=$!
+	sleep 0.5
+
+	analyze --connect="$sock" "$dir/full.wav" > "$dir/c1.out" 2>/dev/null &
+	c1=$!
+	analyze --connect="$sock" < "$dir/full.wav" > "$dir/c2.out" 2>/dev/null &
+	c2=$!
+	analyze --connect="$sock" --fd=3 3< "$dir/full.wav" \
+		> "$dir/c3.out" 2>/dev/null &
+	c3=$!
+	analyze --connect="$sock" -j 3 "$dir/full.wav" > "$dir/c4.out" \
+		2>/dev/null &
+	c4=$!
+	analyze --connect="$sock" "$dir/none.wav" > /dev/null 2> "$dir/c5.err" &
+	c5=$!
+
+	ret=0
+	for pid in $c1 $c2 $c3 $c4; do
+		wait $pid || ret=1
+	done
+	wait $c5 && ret=1
+	kill -0 $slow 2>/dev/null || ret=1
+	wait $slow || ret=1
+
+	# Statistics are served alone, each client gets its own diagnostics
+	analyze --connect="$sock" --stats "$dir/full.wav" > "$dir/c6.out" \
+		2> "$dir/c6.err" &
+	c6=$!
+	analyze --connect="$sock" "$dir/full.wav" > "$dir/c7.out" \
+		2> "$dir/c7.err" &
+	c7=$!
+	wait $c6 || ret=1
+	wait $c7 || ret=1
+
+	kill $daemon
+	{ wait $daemon; } 2>/dev/null
+
+	for out in slow c1 c2 c3 c4 c6 c7; do
+		cmp -s "$dir/$out.out" "$dir/full.out" || ret=1
+	done
+	grep -q "Cannot open" "$dir/c5.err" || ret=1
+	grep -q "Statistics" "$dir/c6.err" || ret=1
+	grep -q "Statistics\|Cannot open" "$dir/c7.err" && ret=1
+
+	return $ret
+}
+
+# A placeholder data size stands for the rest of the file or of the stream,
+# a trailing partial frame being ignored
+placeholder()
+{
+	{
+		head -c 40 "$dir/full.wav"
+		le32 "$1"
+		tail -c +45 "$dir/full.wav"
+		printf x
+	} > "$dir/placeholder.wav"
+
+	analyze "$dir/placeholder.wav" 2>/dev/null | cmp -s - "$dir/full.out" &&
+		analyze < "$dir/placeholder.wav" 2>/dev/null |
+		cmp -s - "$dir/full.out" &&
+		cat "$dir/placeholder.wav" | analyze 2>/dev/null |
+		cmp -s - "$dir/full.out"
+}
+
+# Analyze a rebuilt file as a mapped file and as a stream
+same_analysis()
+{
+	analyze "$1" 2>/dev/null | cmp -s - "$dir/full.out" &&
+		cat "$1" | analyze 2>/dev/null | cmp -s - "$dir/full.out"
+}
+
+# Odd-sized chunks, padded to a word, around the fmt chunk
+riff_chunks()
+{
+	data_sz=$(($(wc -c < "$dir/full.wav") - 44))
+
+	{
+		printf RIFF
+		le32 $((4 + 14 + 24 + 12 + 8 + data_sz))
+		printf WAVELIST
+		le32 5
+		printf 'INFO\0\0'
+		tail -c +13 "$dir/full.wav" | head -c 24
+		printf fact
+		le32 3
+		printf '\1\2\3\0'
+		printf data
+		le32 $data_sz
+		tail -c +45 "$dir/full.wav"
+	} > "$dir/chunks.wav"
+
+	same_analysis "$dir/chunks.wav"
+}
+
+# PCM described by a WAVE_FORMAT_EXTENSIBLE fmt chunk
+riff_extensible()
+{
+	data_sz=$(($(wc -c < "$dir/full.wav") - 44))
+
+	{
+		printf RIFF
+		le32 $((4 + 48 + 8 + data_sz))
+		printf 'WAVEfmt '
+		le32 40
+		le16 0xFFFE
+		tail -c +23 "$dir/full.wav" | head -c 14
+		le16 22
+		le16 16
+		le32 3
+		le16 1
+		printf '\0\0\0\0\20\0\200\0\0\252\0\70\233\161'
+		printf data
+		le32 $data_sz
+		tail -c +45 "$dir/full.wav"
+	} > "$dir/extensible.wav"
+
+	same_analysis "$dir/extensible.wav"
+}
+
+# Merged shards of a manifest match the unsharded analysis, in any order
+shard_merge()
+{
+	mkdir "$dir/campaign"
+	cp "$dir/full.wav" "$dir/campaign/a.wav"
+	gen -d 4 -c 3 -b 24 -f 3 > "$dir/campaign/b.wav"
+	gen -d 5 -c 1 > "$dir/campaign/c.wav"
+	cp "$dir/full.wav" "$dir/campaign/d.wav"
+	printf 'a.wav\nb.wav\nc.wav\nd.wav\n' > "$dir/campaign/manifest"
+
+	manifest=$dir/campaign/manifest
+	analyze --manifest="$manifest" > "$dir/campaign.out" 2>/dev/null &&
+		analyze --manifest="$manifest" --shard=0/2 > "$dir/shard0" \
+		2>/dev/null &&
+		analyze --manifest="$manifest" --shard=1/2 -j 2 > "$dir/shard1" \
+		2>/dev/null || return 1
+
+	analyze --merge "$dir/shard0" "$dir/shard1" 2>/dev/null |
+		cmp -s - "$dir/campaign.out" &&
+		analyze --merge "$dir/shard1" "$dir/shard0" 2>/dev/null |
+		cmp -s - "$dir/campaign.out" &&
+		! analyze --merge "$dir/shard0" > /dev/null 2>&1
+}
+
+gen -d 3 -c 2 -b 16 > "$dir/full.wav"
+analyze "$dir/full.wav" > "$dir/full.out" 2>/dev/null
+
+result follow-completed follow_completed
+result follow-truncated follow_truncated
+result follow-pipe-completed follow_pipe_completed
+result follow-pipe-truncated follow_pipe_truncated
+result daemon-clients daemon_clients
+result placeholder-0 placeholder 0
+result placeholder-7fffffff placeholder 0x7FFFFFFF
+result placeholder-ffffffff placeholder 0xFFFFFFFF
+result riff-chunks riff_chunks
+result riff-extensible riff_extensible
+result shard-merge shard_merge
+
+[ $failures -eq 0 ]
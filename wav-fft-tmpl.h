@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Precision dependent FFT code, included by wav-fft.c once per precision
+ * with:
+ * - FFT_T: the type of the samples
+ * - FFT_ACC_T: the type of the intermediate products
+ * - FFT_FN(): suffixes names with the precision
+ * - FFT_FROM_DOUBLE(): converts a twiddle factor
+ * - FFT_MUL(): multiplies a sample by a twiddle factor
+ * - FFT_STAGE(): scales the outputs of a stage, fixed point transforms are
+ *   divided by 2 at each stage to avoid overflows
+ */
+
+static void FFT_FN(fill_twiddles)(struct fft_plan *plan)
+{
+	FFT_T *cos_tbl = plan->cos, *sin_tbl = plan->sin;
+	unsigned int i;
+
+	for (i = 0; i < plan->size / 2; i++) {
+		cos_tbl[i] = FFT_FROM_DOUBLE(cos(2.0 * M_PI * i / plan->size));
+		sin_tbl[i] = FFT_FROM_DOUBLE(-sin(2.0 * M_PI * i / plan->size));
+	}
+}
+
+static inline void FFT_FN(swap_lanes)(FFT_T *restrict a, FFT_T *restrict b)
+{
+	FFT_T tmp;
+	unsigned int l;
+
+	for (l = 0; l < FFT_LANES; l++) {
+		tmp = a[l];
+		a[l] = b[l];
+		b[l] = tmp;
+	}
+}
+
+static inline void FFT_FN(butterfly)(FFT_T *restrict re0, FFT_T *restrict im0,
+				     FFT_T *restrict re1, FFT_T *restrict im1,
+				     FFT_T wr, FFT_T wi)
+{
+	FFT_ACC_T vr, vi;
+	unsigned int l;
+
+	for (l = 0; l < FFT_LANES; l++) {
+		vr = FFT_MUL(re1[l], wr) - FFT_MUL(im1[l], wi);
+		vi = FFT_MUL(re1[l], wi) + FFT_MUL(im1[l], wr);
+		re1[l] = FFT_STAGE(re0[l] - vr);
+		im1[l] = FFT_STAGE(im0[l] - vi);
+		re0[l] = FFT_STAGE(re0[l] + vr);
+		im0[l] = FFT_STAGE(im0[l] + vi);
+	}
+}
+
+/* In-place decimation in time, the output is in natural order */
+static void FFT_FN(batch_forward)(const struct fft_plan *plan, FFT_T *re,
+				  FFT_T *im)
+{
+	const FFT_T *cos_tbl = plan->cos, *sin_tbl = plan->sin;
+	unsigned int size = plan->size, half, step, i, j, k;
+
+	for (i = 0; i < size; i++) {
+		j = plan->bitrev[i];
+		if (i < j) {
+			FFT_FN(swap_lanes)(&re[i * FFT_LANES], &re[j * FFT_LANES]);
+			FFT_FN(swap_lanes)(&im[i * FFT_LANES], &im[j * FFT_LANES]);
+		}
+	}
+
+	for (half = 1; half < size; half *= 2) {
+		step = size / (2 * half);
+		for (i = 0; i < size; i += 2 * half) {
+			for (k = 0; k < half; k++) {
+				j = i + k;
+				FFT_FN(butterfly)(&re[j * FFT_LANES], &im[j * FFT_LANES],
+						  &re[(j + half) * FFT_LANES],
+						  &im[(j + half) * FFT_LANES],
+						  cos_tbl[k * step], sin_tbl[k * step]);
+			}
+		}
+	}
+}
@@ -0,0 +1,140 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include "wav-lib.h"
+#include "wav-fft.h"
+
+#define FFT_T double
+#define FFT_ACC_T double
+#define FFT_FN(name) name##_double
+#define FFT_FROM_DOUBLE(x) (x)
+#define FFT_MUL(a, b) ((a) * (b))
+#define FFT_STAGE(x) (x)
+#include "wav-fft-tmpl.h"
+#undef FFT_T
+#undef FFT_ACC_T
+#undef FFT_FN
+#undef FFT_FROM_DOUBLE
+#undef FFT_MUL
+#undef FFT_STAGE
+
+#define FFT_T float
+#define FFT_ACC_T float
+#define FFT_FN(name) name##_float
+#define FFT_FROM_DOUBLE(x) (x)
+#define FFT_MUL(a, b) ((a) * (b))
+#define FFT_STAGE(x) (x)
+#include "wav-fft-tmpl.h"
+#undef FFT_T
+#undef FFT_ACC_T
+#undef FFT_FN
+#undef FFT_FROM_DOUBLE
+#undef FFT_MUL
+#undef FFT_STAGE
+
+/* Q31 samples and twiddle factors, products are accumulated on 64 bits */
+#define FFT_T int32_t
+#define FFT_ACC_T int64_t
+#define FFT_FN(name) name##_fixed
+#define FFT_FROM_DOUBLE(x) ((int32_t)lrint((x) * INT32_MAX))
+#define FFT_MUL(a, b) (((int64_t)(a) * (b)) >> 31)
+#define FFT_STAGE(x) ((int32_t)((x) >> 1))
+#include "wav-fft-tmpl.h"
+#undef FFT_T
+#undef FFT_ACC_T
+#undef FFT_FN
+#undef FFT_FROM_DOUBLE
+#undef FFT_MUL
+#undef FFT_STAGE
+
+static size_t fft_sample_size(enum precision precision)
+{
+	switch (precision) {
+	case PRECISION_FLOAT:
+		return sizeof(float);
+	case PRECISION_FIXED:
+		return sizeof(int32_t);
+	case PRECISION_DOUBLE:
+	default:
+		return sizeof(double);
+	}
+}
+
+/* Prepare the bit-reversal permutation and the twiddle factors of a
+ * forward transform, size must be a power of 2.
+ */
+struct fft_plan *fft_plan_alloc(unsigned int size, enum precision precision)
+{
+	struct fft_plan *plan;
+	unsigned int bits, i, b;
+
+	if (size < 2 || size & (size - 1))
+		return NULL;
+
+	plan = calloc(1, sizeof(*plan));
+	if (!plan)
+		return NULL;
+
+	plan->size = size;
+	plan->precision = precision;
+	plan->bitrev = mem_alloc(size * sizeof(*plan->bitrev));
+	plan->cos = mem_alloc(size / 2 * fft_sample_size(precision));
+	plan->sin = mem_alloc(size / 2 * fft_sample_size(precision));
+	if (!plan->bitrev || !plan->cos || !plan->sin) {
+		fft_plan_free(plan);
+		return NULL;
+	}
+
+	for (bits = 0; (1U << bits) < size; bits++)
+		;
+
+	for (i = 0; i < size; i++) {
+		plan->bitrev[i] = 0;
+		for (b = 0; b < bits; b++)
+			if (i & (1U << b))
+				plan->bitrev[i] |= 1U << (bits - 1 - b);
+	}
+
+	switch (precision) {
+	case PRECISION_DOUBLE:
+		fill_twiddles_double(plan);
+		break;
+	case PRECISION_FLOAT:
+		fill_twiddles_float(plan);
+		break;
+	case PRECISION_FIXED:
+		fill_twiddles_fixed(plan);
+		break;
+	}
+
+	return plan;
+}
+
+void fft_plan_free(struct fft_plan *plan)
+{
+	if (!plan)
+		return;
+
+	mem_free(plan->bitrev);
+	mem_free(plan->cos);
+	mem_free(plan->sin);
+	free(plan);
+}
+
+void fft_batch_forward(const struct fft_plan *plan, void *re, void *im)
+{
+	switch (plan->precision) {
+	case PRECISION_DOUBLE:
+		batch_forward_double(plan, re, im);
+		break;
+	case PRECISION_FLOAT:
+		batch_forward_float(plan, re, im);
+		break;
+	case PRECISION_FIXED:
+		batch_forward_fixed(plan, re, im);
+		break;
+	}
+}
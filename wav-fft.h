@@ -0,0 +1,36 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2023 Bootlin
+ * Author: Miquel Raynal <miquel.raynal@bootlin.com>
+ */
+
+/*
+ * Batched radix-2 complex FFT: FFT_LANES independent transforms of the same
+ * size are performed at once. Samples are interleaved so that each lane
+ * carries a different transform, which lets the compiler use one SIMD lane
+ * per transform:
+ *   re[i * FFT_LANES + lane], im[i * FFT_LANES + lane]
+ * The type of the samples depends on the precision of the plan: double,
+ * float or Q31 fixed point (int32_t). Fixed point transforms are scaled
+ * down by the size of the transform.
+ */
+
+#define FFT_LANES 4
+
+enum precision {
+	PRECISION_DOUBLE,
+	PRECISION_FLOAT,
+	PRECISION_FIXED,
+};
+
+struct fft_plan {
+	unsigned int size;
+	enum precision precision;
+	unsigned int *bitrev;
+	void *cos;
+	void *sin;
+};
+
+struct fft_plan *fft_plan_alloc(unsigned int size, enum precision precision);
+void fft_plan_free(struct fft_plan *plan);
+void fft_batch_forward(const struct fft_plan *plan, void *re, void *im);
@@ -10,9 +10,12 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <unistd.h>
+#include <getopt.h>
 #include <math.h>
 
 #include "wav-lib.h"
+#include "wav-kernels.h"
+#include "wav-stats.h"
 
 #define DEFAULT_NCHANS 2
 #define DEFAULT_RATE 48000
@@ -20,50 +23,94 @@
 #define DEFAULT_DURATION 10
 #define DEFAULT_NFREQS 4
 
-static void fill_audio_buf(uint8_t *buf, double **waves, const struct audio *wav)
+/* Blocks generated under a memory limit, aligned so that the SIMD kernels see
+ * the same samples as when the whole file is generated at once.
+ */
+#define BLOCK_ALIGN 64
+#define MIN_BLOCK_FRAMES 1024
+
+/* Time spent in each stage of the generation and what it produced */
+enum generator_stage {
+	STAGE_SYNTHESIS,
+	STAGE_CONVERT,
+	STAGE_WRITE,
+	NSTAGES,
+};
+
+enum generator_counter {
+	COUNTER_BYTES,
+	COUNTER_SAMPLES,
+	NCOUNTERS,
+};
+
+static struct stats_entry stages[NSTAGES] = {
+	[STAGE_SYNTHESIS] = { .name = "synthesis" },
+	[STAGE_CONVERT] = { .name = "convert" },
+	[STAGE_WRITE] = { .name = "write" },
+};
+
+static struct stats_entry counters[NCOUNTERS] = {
+	[COUNTER_BYTES] = { .name = "bytes" },
+	[COUNTER_SAMPLES] = { .name = "samples" },
+};
+
+static struct stats stats = {
+	.stages = stages,
+	.nstages = NSTAGES,
+	.counters = counters,
+	.ncounters = NCOUNTERS,
+};
+
+static void fill_audio_buf(uint8_t *buf, double **waves, const struct audio *wav,
+			   unsigned int n)
 {
-	int16_t *buf_i16 = (int16_t *)buf;
-	int24_t *buf_i24 = (int24_t *)buf;
-	int32_t *buf_i32 = (int32_t *)buf;
-	unsigned int s, c;
-
-	switch (wav->bits_per_sample) {
-	case 16:
-		for (s = 0; s < wav->samples_per_chan; s++)
-			for (c = 0; c < wav->channels; c++)
-				buf_i16[(s * wav->channels) + c] = waves[c][s] * INT16_MAX;
-		break;
-	case 24:
-		for (s = 0; s < wav->samples_per_chan; s++)
-			for (c = 0; c < wav->channels; c++)
-				buf_i24[(s * wav->channels) + c] =
-					i32_to_i24((int32_t)(waves[c][s] * 0x7FFFFF));
-		break;
-	case 32:
-		for (s = 0; s < wav->samples_per_chan; s++)
-			for (c = 0; c < wav->channels; c++)
-				buf_i32[(s * wav->channels) + c] = waves[c][s] * INT32_MAX;
-		break;
-	default:
-		/* Checked in parse_args() */
-		break;
-	};
+	kernels->pcm_from_double(buf, waves, wav->channels, wav->bits_per_sample,
+				 n);
 }
 
-static void fill_audio_wave(double *wave, unsigned int *freqs, const struct audio *wav)
+/* Synthesizes the n samples of a channel starting at sample 'start' */
+static void fill_audio_wave(double *wave, unsigned int *freqs, const struct audio *wav,
+			    unsigned int start, unsigned int n)
 {
 	unsigned int s, f;
 
 	/* w(t) = sin(2 PI f t) */
-	for (s = 0; s < wav->samples_per_chan; s++) {
+	for (s = start; s < start + n; s++) {
+		wave[s - start] = 0;
 		for (f = 0; f < wav->freqs_per_chan; f++)
-			wave[s] += sin(2.0 * M_PI * freqs[f] * s / wav->sample_rate);
+			wave[s - start] += sin(2.0 * M_PI * freqs[f] * s / wav->sample_rate);
 
 		/* Normalize power */
-		wave[s] /= wav->freqs_per_chan;
+		wave[s - start] /= wav->freqs_per_chan;
 	}
 }
 
+/* Number of frames generated at once: the whole file unless it does not fit in
+ * the memory limit (in MiB), 0 if not even a minimal block fits.
+ */
+static unsigned int block_frames(const struct audio *wav, unsigned int mem_limit)
+{
+	size_t frame = wav->channels * (sizeof(double) + wav->bits_per_sample / 8);
+	size_t frames;
+
+	if (!mem_limit)
+		return wav->samples_per_chan;
+
+	frames = ((size_t)mem_limit << 20) / frame;
+	if (frames >= wav->samples_per_chan)
+		return wav->samples_per_chan;
+
+	frames -= frames % BLOCK_ALIGN;
+	if (frames < MIN_BLOCK_FRAMES) {
+		fprintf(stderr, "Memory limit of %u MiB too low: needs at least %zu KiB (%zu KiB for the whole file)\n",
+			mem_limit, (MIN_BLOCK_FRAMES * frame + 1023) >> 10,
+			((size_t)wav->samples_per_chan * frame + 1023) >> 10);
+		return 0;
+	}
+
+	return frames;
+}
+
 static void log_freqs(FILE *fd, unsigned int **freqs, const struct audio *wav)
 {
 	unsigned int c, i;
@@ -81,22 +128,50 @@ static void print_help(FILE *fd, char *tool_name)
 	fprintf(fd, "\n"
 		"Generates a WAV audio file on the standard output, with a number of known frequencies added on each channel.\n"
 		"Listening to this file is discouraged, as pure sinewaves are as mathematically beautiful as unpleasant to the human ears.\n\n"
-		"%s [-c <nchans>] [-r <rate>] [-b <bps>] [-d <duration>] [-f <nfreqs>] > play.wav\n"
+		"%s [-c <nchans>] [-r <rate>] [-b <bps>] [-d <duration>] [-f <nfreqs>] [--stats[=<fmt>]] [--trace=<file>] [--perf-counters] [--mem-limit=<MiB>] > play.wav\n"
 		"	-c: Number of channels (default: %u)\n"
 		"	-r: Sampling rate in Hz (default: %u, min: %u)\n"
 		"	-b: Bits per sample (default: %u, supp: 16, 24, 32)\n"
 		"	-d: Duration in seconds (default: %u, min: %u)\n"
-		"	-f: Number of frequencies per channel (default: %u)\n\n",
+		"	-f: Number of frequencies per channel (default: %u)\n"
+		"	--stats: Print the time spent in each stage and the throughput on the\n"
+		"	         standard error, as text or json (default: text)\n"
+		"	--trace: Record the stages and write them to a file in the Chrome\n"
+		"	         trace event format (chrome://tracing, Perfetto)\n"
+		"	--perf-counters: Count the cycles, instructions, cache and branch\n"
+		"	                 misses of each stage along with its time, when the\n"
+		"	                 host provides hardware counters\n"
+		"	--mem-limit: Generate the file in blocks so that the buffers fit in\n"
+		"	             this many MiB\n"
+		"Set %s to force the SIMD kernels (scalar, sse2, avx2, avx512)\n\n",
 		tool_name, DEFAULT_NCHANS, DEFAULT_RATE, 2 * MIN_FREQ, DEFAULT_BPS,
-		DEFAULT_DURATION, MIN_DURATION, DEFAULT_NFREQS);
+		DEFAULT_DURATION, MIN_DURATION, DEFAULT_NFREQS, KERNELS_ENV);
 }
 
-static int parse_args(int argc, char *argv[], struct audio *wav)
+enum {
+	OPT_STATS = 256,
+	OPT_TRACE,
+	OPT_MEM_LIMIT,
+	OPT_PERF_COUNTERS,
+};
+
+static const struct option long_options[] = {
+	{ "stats", optional_argument, NULL, OPT_STATS },
+	{ "trace", required_argument, NULL, OPT_TRACE },
+	{ "mem-limit", required_argument, NULL, OPT_MEM_LIMIT },
+	{ "perf-counters", no_argument, NULL, OPT_PERF_COUNTERS },
+	{ NULL, 0, NULL, 0 },
+};
+
+static int parse_args(int argc, char *argv[], struct audio *wav,
+		      enum stats_format *stats_format, const char **trace,
+		      unsigned int *mem_limit, bool *perf_counters)
 {
 	char *tool_name = argv[0];
 	int option, val;
 
-	while ((option = getopt(argc, argv, ":c:r:b:d:f:h")) != -1) {
+	while ((option = getopt_long(argc, argv, ":c:r:b:d:f:h",
+				     long_options, NULL)) != -1) {
 		switch(option){
 		case 'c':
 			val = strtol(optarg, NULL, 0);
@@ -118,6 +193,27 @@ static int parse_args(int argc, char *argv[], struct audio *wav)
 			val = strtol(optarg, NULL, 0);
 			wav->freqs_per_chan = val;
 			break;
+		case OPT_STATS:
+			val = 1;
+			if (stats_parse(optarg, stats_format)) {
+				fprintf(stderr, "Unknown statistics format: %s\n",
+					optarg);
+				print_help(stderr, tool_name);
+				return -1;
+			}
+			break;
+		case OPT_TRACE:
+			val = 1;
+			*trace = optarg;
+			break;
+		case OPT_MEM_LIMIT:
+			val = strtol(optarg, NULL, 0);
+			*mem_limit = val;
+			break;
+		case OPT_PERF_COUNTERS:
+			val = 1;
+			*perf_counters = true;
+			break;
 		case 'h':
 			print_help(stderr, tool_name);
 			return -1;
@@ -198,17 +294,32 @@ int main(int argc, char *argv[])
 		.freqs_per_chan = DEFAULT_NFREQS,
 	};
 	struct wav_format *hdr = &riff.wav_container.fmt_container.wav_format;
+	enum stats_format stats_format = STATS_OFF;
+	const char *trace = NULL;
+	unsigned int mem_limit = 0;
+	bool perf_counters = false;
 	unsigned int **freqs;
 	unsigned int data_sz;
-	unsigned int c;
+	unsigned int block, s, n, c;
 	double **waves;
 	uint8_t *buf;
 	int ret = -1;
+	uint64_t t;
 
 	/* Parse args */
-	if (parse_args(argc, argv, (struct audio *)&wav))
+	if (parse_args(argc, argv, (struct audio *)&wav, &stats_format,
+		       &trace, &mem_limit, &perf_counters))
+		return -1;
+
+	block = block_frames(&wav, mem_limit);
+	if (!block)
 		return -1;
 
+	if (kernels_init())
+		return -1;
+
+	stats_start(&stats, stats_format, trace != NULL, perf_counters);
+
 	fprintf(stderr, "Generating audio file with following parameters:\n");
 	log_parameters(stderr, &wav);
 	fprintf(stderr, "\n");
@@ -224,45 +335,72 @@ int main(int argc, char *argv[])
 	freqs = (unsigned int **)alloc_matrix(wav.channels, wav.freqs_per_chan,
 					      sizeof(**freqs));
 	if (!freqs)
-		return -1;
+		goto report;
 
 	if (fill_desired_freqs(freqs, &wav))
-		return -1;
+		goto free_freqs;
 
 	log_freqs(stderr, freqs, &wav);
 
-	/* Generate audio waves for each channels */
-	waves = (double **)alloc_matrix(wav.channels, wav.samples_per_chan,
-					sizeof(**waves));
+	/* Audio waves of each channel and audio buffer for a block */
+	waves = (double **)alloc_matrix(wav.channels, block, sizeof(**waves));
 	if (!waves)
 		goto free_freqs;
 
-	for (c = 0; c < wav.channels; c++)
-		fill_audio_wave(waves[c], freqs[c], &wav);
-
-	/* Generate audio buffer */
-	data_sz = wav.channels * wav.samples_per_chan * wav.bits_per_sample / 8;
-	buf = calloc(data_sz, 1);
+	buf = mem_calloc(block, wav.channels * wav.bits_per_sample / 8);
 	if (!buf)
 		goto free_waves;
 
-	fill_audio_buf(buf, waves, &wav);
-
 	/* Generate the final *.wav output */
+	data_sz = wav.channels * wav.samples_per_chan * wav.bits_per_sample / 8;
 	riff.wav_container.fmt_container.wav_format.data_container.chunk_size = data_sz;
 	riff.file_len = sizeof(riff) + data_sz;
 
+	t = stats_now(&stats);
 	fwrite(&riff, sizeof(riff), 1, stdout);
-	fwrite(buf, data_sz, 1, stdout);
+	stats_stage(&stats, STAGE_WRITE, t);
+
+	for (s = 0; s < wav.samples_per_chan; s += n) {
+		n = wav.samples_per_chan - s;
+		if (n > block)
+			n = block;
+
+		t = stats_now(&stats);
+		for (c = 0; c < wav.channels; c++)
+			fill_audio_wave(waves[c], freqs[c], &wav, s, n);
+		stats_stage(&stats, STAGE_SYNTHESIS, t);
+
+		t = stats_now(&stats);
+		fill_audio_buf(buf, waves, &wav, n);
+		stats_stage(&stats, STAGE_CONVERT, t);
+
+		t = stats_now(&stats);
+		fwrite(buf, n * wav.channels * wav.bits_per_sample / 8, 1, stdout);
+		stats_stage(&stats, STAGE_WRITE, t);
+	}
+
+	t = stats_now(&stats);
+	fflush(stdout);
+	stats_stage(&stats, STAGE_WRITE, t);
+	stats_count(&stats, COUNTER_SAMPLES,
+		    (uint64_t)wav.channels * wav.samples_per_chan);
+	stats_count(&stats, COUNTER_BYTES, sizeof(riff) + data_sz);
+
+	stats_print(&stats, stderr, "wav-generator", COUNTER_BYTES,
+		    COUNTER_SAMPLES);
 
 	ret = 0;
-	free(buf);
+	if (trace && stats_trace_dump(&stats, trace))
+		ret = -1;
+	mem_free(buf);
 free_waves:
-	free_array((void **)waves, c);
+	free_array((void **)waves, wav.channels);
 	free(waves);
 free_freqs:
-	free_array((void **)freqs, c);
+	free_array((void **)freqs, wav.channels);
 	free(freqs);
+report:
+	mem_report(stderr);
 
 	return ret;
 }
@@ -0,0 +1,448 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <errno.h>
+#include <limits.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/inotify.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "wav-lib.h"
+#include "wav-input.h"
+
+static void input_init(struct input *in, FILE *file, bool follow)
+{
+	in->file = file;
+	in->map = NULL;
+	in->ring = NULL;
+	in->follow = follow;
+	in->closed = false;
+	in->sized = false;
+	in->notify = -1;
+	atomic_init(&in->interrupted, false);
+}
+
+/* Reading remains possible if the mapping fails */
+static void input_map(struct input *in)
+{
+	struct stat st;
+	off_t pos;
+	void *map;
+
+	if (fstat(fileno(in->file), &st) || !S_ISREG(st.st_mode) || !st.st_size)
+		return;
+
+	pos = lseek(fileno(in->file), 0, SEEK_CUR);
+	if (pos < 0 || pos > st.st_size)
+		return;
+
+	map = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fileno(in->file), 0);
+	if (map == MAP_FAILED)
+		return;
+
+	madvise(map, st.st_size, MADV_SEQUENTIAL);
+	in->map = map;
+	in->map_len = st.st_size;
+	in->pos = pos;
+}
+
+int input_open(struct input *in, const char *path, bool follow)
+{
+	struct stat st;
+	FILE *file;
+
+	if (path) {
+		file = fopen(path, "rb");
+		if (!file) {
+			fprintf(diag(), "Cannot open %s\n", path);
+			return -1;
+		}
+	} else {
+		file = freopen(NULL, "rb", stdin);
+		if (!file)
+			return -1;
+	}
+
+	input_init(in, file, follow);
+
+	/* A growing file cannot be mapped, fall back to polling without
+	 * inotify.
+	 */
+	if (follow) {
+		/* The end of a pipe is final, its writer is gone, a file
+		 * redirected to the standard input is watched like a path.
+		 */
+		if (!path) {
+			if (fstat(fileno(file), &st) || !S_ISREG(st.st_mode)) {
+				in->closed = true;
+				return 0;
+			}
+
+			path = "/dev/stdin";
+		}
+
+		in->notify = inotify_init1(IN_CLOEXEC);
+		if (in->notify >= 0 &&
+		    inotify_add_watch(in->notify, path,
+				      IN_MODIFY | IN_CLOSE_WRITE) < 0) {
+			close(in->notify);
+			in->notify = -1;
+		}
+
+		return 0;
+	}
+
+	input_map(in);
+
+	return 0;
+}
+
+int input_open_fd(struct input *in, int fd)
+{
+	FILE *file;
+
+	lseek(fd, 0, SEEK_SET);
+	file = fdopen(fd, "rb");
+	if (!file) {
+		if (fd >= 0)
+			close(fd);
+		return -1;
+	}
+
+	input_init(in, file, false);
+	input_map(in);
+
+	return 0;
+}
+
+void input_close(struct input *in)
+{
+	if (in->notify >= 0)
+		close(in->notify);
+
+	if (in->map)
+		munmap(in->map, in->map_len);
+
+	if (in->file != stdin)
+		fclose(in->file);
+}
+
+/* A closed file whose data is not complete yet may be appended to by another
+ * writer, it is over once its size did not change for a while.
+ */
+static bool input_closed_for_good(struct input *in)
+{
+	struct stat st;
+
+	if (!in->sized)
+		return true;
+
+	if (fstat(fileno(in->file), &st) || !S_ISREG(st.st_mode))
+		return true;
+
+	if (st.st_size != in->closed_size) {
+		in->closed_size = st.st_size;
+		in->closed_polls = 0;
+		return false;
+	}
+
+	return ++in->closed_polls >= INPUT_CLOSE_POLLS;
+}
+
+/* Wait for a followed file to grow, false once it will not anymore */
+static bool input_wait(struct input *in)
+{
+	struct pollfd pfd = { .fd = in->notify, .events = POLLIN };
+	char events[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+	const struct inotify_event *event;
+	ssize_t len, i;
+
+	/* Data written before the close was already read */
+	if (!in->follow || (in->closed && input_closed_for_good(in)))
+		return false;
+
+	if (in->notify < 0) {
+		poll(NULL, 0, INPUT_POLL_MS);
+	} else if (poll(&pfd, 1, INPUT_POLL_MS) > 0) {
+		len = read(in->notify, events, sizeof(events));
+		for (i = 0; i < len; i += sizeof(*event) + event->len) {
+			event = (const struct inotify_event *)&events[i];
+			if (event->mask & IN_CLOSE_WRITE) {
+				in->closed = true;
+				in->closed_size = -1;
+			} else if (event->mask & IN_MODIFY) {
+				in->closed = false;
+			}
+		}
+	}
+
+	return !atomic_load(&in->interrupted) &&
+	       !(in->ring && atomic_load(&in->ring->stop));
+}
+
+/* Read a followed file as it grows */
+static size_t input_fread(struct input *in, void *buf, size_t len)
+{
+	size_t done = 0;
+
+	for (;;) {
+		done += fread((uint8_t *)buf + done, 1, len - done, in->file);
+		if (done == len || !input_wait(in))
+			return done;
+
+		clearerr(in->file);
+	}
+}
+
+size_t input_read(struct input *in, void *buf, size_t len)
+{
+	if (!in->map)
+		return input_fread(in, buf, len);
+
+	if (len > in->map_len - in->pos)
+		len = in->map_len - in->pos;
+
+	memcpy(buf, in->map + in->pos, len);
+	in->pos += len;
+
+	return len;
+}
+
+/* Skip bytes without copying them, unless the input cannot seek */
+size_t input_skip(struct input *in, size_t len)
+{
+	uint8_t buf[4096];
+	size_t done, sz;
+
+	if (in->map) {
+		if (len > in->map_len - in->pos)
+			len = in->map_len - in->pos;
+
+		in->pos += len;
+		return len;
+	}
+
+	if (len <= LONG_MAX && !fseek(in->file, len, SEEK_CUR))
+		return len;
+
+	for (done = 0; done < len; done += sz) {
+		sz = len - done < sizeof(buf) ? len - done : sizeof(buf);
+		sz = input_fread(in, buf, sz);
+		if (!sz)
+			break;
+	}
+
+	return done;
+}
+
+const uint8_t *input_mapped(struct input *in, size_t len)
+{
+	if (!in->map || len > in->map_len - in->pos)
+		return NULL;
+
+	return in->map + in->pos;
+}
+
+size_t input_avail(struct input *in)
+{
+	return in->map ? in->map_len - in->pos : 0;
+}
+
+/* Read the rest of a mapped input instead, to bound its resident memory */
+int input_unmap(struct input *in)
+{
+	if (!in->map)
+		return 0;
+
+	if (fseeko(in->file, in->pos, SEEK_SET))
+		return -1;
+
+	munmap(in->map, in->map_len);
+	in->map = NULL;
+
+	return 0;
+}
+
+/* Semaphores are not restarted after a signal handler */
+static void input_sem_wait(sem_t *sem)
+{
+	while (sem_wait(sem) && errno == EINTR)
+		;
+}
+
+/* Fill the ring with the chunks of the input, stop at the end of the data,
+ * on a short read (the end of a stream of unknown length) or when asked to.
+ */
+static void *input_reader(void *data)
+{
+	struct input *in = data;
+	struct input_ring *ring = in->ring;
+	size_t expected, len;
+	unsigned int slot;
+
+	while (ring->left) {
+		expected = ring->next;
+		if (expected > ring->left)
+			expected = ring->left;
+
+		input_sem_wait(&ring->freed);
+		if (atomic_load(&ring->stop))
+			break;
+
+		slot = ring->head++ % INPUT_RING_SLOTS;
+		len = input_fread(in, ring->slots[slot], expected);
+		ring->lens[slot] = len;
+		sem_post(&ring->filled);
+		if (len < expected)
+			break;
+
+		if (ring->left != INPUT_UNTIL_EOF)
+			ring->left -= len;
+		ring->next = ring->chunk;
+	}
+
+	return NULL;
+}
+
+static void input_free_ring(struct input_ring *ring)
+{
+	unsigned int i;
+
+	for (i = 0; i < INPUT_RING_SLOTS; i++)
+		mem_free(ring->slots[i]);
+
+	free(ring);
+}
+
+int input_start(struct input *in, size_t first, size_t chunk, size_t len)
+{
+	struct input_ring *ring;
+	unsigned int i;
+
+	in->next = first;
+	in->chunk = chunk;
+	in->left = len;
+	in->sized = len != INPUT_UNTIL_EOF;
+	if (in->map)
+		return 0;
+
+	ring = calloc(1, sizeof(*ring));
+	if (!ring)
+		return -1;
+
+	for (i = 0; i < INPUT_RING_SLOTS; i++) {
+		ring->slots[i] = mem_alloc(first > chunk ? first : chunk);
+		if (!ring->slots[i])
+			goto free_ring;
+	}
+
+	ring->next = first;
+	ring->chunk = chunk;
+	ring->left = len;
+	atomic_init(&ring->stop, false);
+	sem_init(&ring->filled, 0, 0);
+	sem_init(&ring->freed, 0, INPUT_RING_SLOTS);
+	in->ring = ring;
+	if (pthread_create(&ring->reader, NULL, input_reader, in)) {
+		in->ring = NULL;
+		goto destroy_sems;
+	}
+
+	return 0;
+
+destroy_sems:
+	sem_destroy(&ring->filled);
+	sem_destroy(&ring->freed);
+free_ring:
+	input_free_ring(ring);
+
+	return -1;
+}
+
+int input_next(struct input *in, const uint8_t **chunk, size_t *len)
+{
+	struct input_ring *ring = in->ring;
+	size_t expected = in->next;
+
+	if (!in->left)
+		return 0;
+
+	if (expected > in->left)
+		expected = in->left;
+
+	if (ring) {
+		input_sem_wait(&ring->filled);
+		*chunk = ring->slots[ring->tail % INPUT_RING_SLOTS];
+		*len = ring->lens[ring->tail % INPUT_RING_SLOTS];
+	} else {
+		*chunk = in->map + in->pos;
+		*len = in->map_len - in->pos;
+		if (*len > expected)
+			*len = expected;
+		in->pos += *len;
+	}
+
+	if (in->left == INPUT_UNTIL_EOF ||
+	    (in->follow && atomic_load(&in->interrupted))) {
+		/* A short chunk is the last one, a followed file may also be
+		 * interrupted before the end of its data.
+		 */
+		if (*len < expected)
+			in->left = 0;
+		else if (in->left != INPUT_UNTIL_EOF)
+			in->left -= *len;
+
+		if (!*len) {
+			input_release(in);
+			return 0;
+		}
+	} else if (*len < expected) {
+		fprintf(diag(), "Partial audio content, aborting\n");
+		input_release(in);
+		return -1;
+	} else {
+		in->left -= *len;
+	}
+
+	in->next = in->chunk;
+
+	return 1;
+}
+
+void input_release(struct input *in)
+{
+	struct input_ring *ring = in->ring;
+
+	if (!ring)
+		return;
+
+	ring->tail++;
+	sem_post(&ring->freed);
+}
+
+void input_stop(struct input *in)
+{
+	struct input_ring *ring = in->ring;
+
+	if (!ring)
+		return;
+
+	/* Wake the reader up in case it waits for a free slot */
+	atomic_store(&ring->stop, true);
+	sem_post(&ring->freed);
+	pthread_join(ring->reader, NULL);
+
+	sem_destroy(&ring->filled);
+	sem_destroy(&ring->freed);
+	input_free_ring(ring);
+	in->ring = NULL;
+}
+
+void input_interrupt(struct input *in)
+{
+	atomic_store(&in->interrupted, true);
+}
@@ -0,0 +1,96 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2023 Bootlin
+ * Author: Miquel Raynal <miquel.raynal@bootlin.com>
+ */
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <sys/types.h>
+
+/*
+ * Audio input of the analyzer: a path, the standard input or a descriptor,
+ * which then belongs to the input. Regular files are mapped so the samples
+ * are read straight from the page cache, other inputs (pipes, sockets) are
+ * read by a separate thread into a ring of chunks, overlapping I/O with the
+ * analysis. A seekable descriptor, such as a memfd filled by another process,
+ * is read from its start whatever its offset.
+ *
+ * Once the header is read, the data is consumed chunk by chunk: a first
+ * chunk of 'first' bytes, then chunks of 'chunk' bytes. input_next()
+ * returns 1 with the next chunk, which must be given back with
+ * input_release(), 0 at the end of the data and -1 if the input ended
+ * prematurely. With a length of INPUT_UNTIL_EOF, the data goes on until the
+ * end of the input and the last chunk may be short. Alternatively,
+ * input_mapped() gives a direct access to the next bytes of a mapped input,
+ * input_avail() tells how many there are, input_unmap() streams them instead.
+ *
+ * A followed file is still being written: reads wait for it to grow until
+ * the writer closes it or input_interrupt() is called, which is async signal
+ * safe. Several writers may append to it in turn: when the length of the data
+ * is known, a close only ends it once the file stopped growing for
+ * INPUT_CLOSE_POLLS polls, and data ending short of its length is then a
+ * partial content, unless interrupted. The end of a followed pipe is
+ * final.
+ */
+
+#define INPUT_UNTIL_EOF SIZE_MAX
+
+#define INPUT_RING_SLOTS 4
+#define INPUT_POLL_MS 200
+#define INPUT_CLOSE_POLLS 10
+
+struct input_ring {
+	pthread_t reader;
+	sem_t filled;
+	sem_t freed;
+	uint8_t *slots[INPUT_RING_SLOTS];
+	size_t lens[INPUT_RING_SLOTS];
+	/* Chunk schedule of the reader */
+	size_t next;
+	size_t chunk;
+	size_t left;
+	unsigned int head;
+	unsigned int tail;
+	atomic_bool stop;
+};
+
+struct input {
+	FILE *file;
+	/* Mapped input */
+	uint8_t *map;
+	size_t map_len;
+	size_t pos;
+	/* Chunk streaming */
+	size_t next;
+	size_t chunk;
+	size_t left;
+	struct input_ring *ring;
+	/* Followed file */
+	bool follow;
+	bool closed;
+	/* Length of the data known, size when closed and polls since */
+	bool sized;
+	off_t closed_size;
+	unsigned int closed_polls;
+	int notify;
+	atomic_bool interrupted;
+};
+
+int input_open(struct input *in, const char *path, bool follow);
+int input_open_fd(struct input *in, int fd);
+void input_close(struct input *in);
+size_t input_read(struct input *in, void *buf, size_t len);
+size_t input_skip(struct input *in, size_t len);
+const uint8_t *input_mapped(struct input *in, size_t len);
+size_t input_avail(struct input *in);
+int input_unmap(struct input *in);
+int input_start(struct input *in, size_t first, size_t chunk, size_t len);
+int input_next(struct input *in, const uint8_t **chunk, size_t *len);
+void input_release(struct input *in);
+void input_stop(struct input *in);
+void input_interrupt(struct input *in);
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Cross-check of the kernels built in against the scalar reference, on random
+ * buffers of every channel count, bit depth and tail length. Run by
+ * "make check", with qemu-user when cross compiling.
+ */
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "wav-lib.h"
+#include "wav-fft.h"
+#include "wav-kernels.h"
+
+#define MAX_CHANNELS 8
+/* Longer than a few vectors of the widest kernels, so every tail is seen */
+#define MAX_SAMPLES 68
+#define MAX_POWER_SIZE 256
+
+static const unsigned int bit_depths[] = { 16, 24, 32 };
+
+static uint32_t rand_state = 0x12345678;
+
+/* xorshift32, for the same buffers whatever the C library */
+static uint32_t check_rand(void)
+{
+	rand_state ^= rand_state << 13;
+	rand_state ^= rand_state >> 17;
+	rand_state ^= rand_state << 5;
+
+	return rand_state;
+}
+
+/* Uniform in [-1; 1] */
+static double check_rand_unit(void)
+{
+	return (double)(int32_t)check_rand() / INT32_MAX;
+}
+
+static void fill_bytes(void *buf, size_t len)
+{
+	uint8_t *bytes = buf;
+	size_t i;
+
+	for (i = 0; i < len; i++)
+		bytes[i] = check_rand();
+}
+
+/* Raw samples as unpacked from a 'bits' deep input */
+static void fill_raw(int32_t *raw, unsigned int bits, unsigned int n)
+{
+	unsigned int s;
+
+	for (s = 0; s < n; s++)
+		raw[s] = (int32_t)check_rand() >> (32 - bits);
+}
+
+static unsigned int failures;
+
+static void check(bool same, const struct kernels *k, const char *kernel,
+		  unsigned int channels, unsigned int bits, unsigned int n)
+{
+	if (same)
+		return;
+
+	fprintf(stderr, "%s: %s differs from the scalar reference (%u channels, %u bits, %u samples)\n",
+		k->name, kernel, channels, bits, n);
+	failures++;
+}
+
+static void check_unpack(const struct kernels *k, unsigned int channels,
+			 unsigned int bits, unsigned int n)
+{
+	int32_t ref[MAX_SAMPLES], out[MAX_SAMPLES];
+	size_t len = (size_t)n * channels * bits / 8;
+	unsigned int chan;
+	uint8_t *buf;
+
+	/* Exactly sized, for the kernels to not rely on any padding */
+	buf = malloc(len ? len : 1);
+	if (!buf)
+		exit(EXIT_FAILURE);
+
+	fill_bytes(buf, len);
+	for (chan = 0; chan < channels; chan++) {
+		memset(ref, 0, sizeof(ref));
+		memset(out, 0, sizeof(out));
+		kernels_scalar.unpack(ref, buf, chan, channels, bits, n);
+		k->unpack(out, buf, chan, channels, bits, n);
+		check(!memcmp(ref, out, sizeof(ref)), k, "unpack", channels,
+		      bits, n);
+	}
+
+	free(buf);
+}
+
+static void check_convert(const struct kernels *k, unsigned int bits,
+			  unsigned int n)
+{
+	double full = bits == 16 ? INT16_MAX : bits == 24 ? 0x7FFFFF : INT32_MAX;
+	double ref_d[MAX_SAMPLES], out_d[MAX_SAMPLES], peak_d;
+	float ref_f[MAX_SAMPLES], out_f[MAX_SAMPLES], peak_f;
+	int32_t ref_q[MAX_SAMPLES], out_q[MAX_SAMPLES], peak_q;
+	int32_t raw[MAX_SAMPLES];
+
+	fill_raw(raw, bits, n);
+
+	memset(ref_d, 0, sizeof(ref_d));
+	memset(out_d, 0, sizeof(out_d));
+	peak_d = kernels_scalar.convert_double(ref_d, raw, full, n);
+	check(k->convert_double(out_d, raw, full, n) == peak_d &&
+	      !memcmp(ref_d, out_d, sizeof(ref_d)), k, "convert_double", 1,
+	      bits, n);
+
+	memset(ref_f, 0, sizeof(ref_f));
+	memset(out_f, 0, sizeof(out_f));
+	peak_f = kernels_scalar.convert_float(ref_f, raw, full, n);
+	check(k->convert_float(out_f, raw, full, n) == peak_f &&
+	      !memcmp(ref_f, out_f, sizeof(ref_f)), k, "convert_float", 1,
+	      bits, n);
+
+	memset(ref_q, 0, sizeof(ref_q));
+	memset(out_q, 0, sizeof(out_q));
+	peak_q = kernels_scalar.convert_fixed(ref_q, raw, 32 - bits, n);
+	check(k->convert_fixed(out_q, raw, 32 - bits, n) == peak_q &&
+	      !memcmp(ref_q, out_q, sizeof(ref_q)), k, "convert_fixed", 1,
+	      bits, n);
+}
+
+/* The lanes between the samples of the windowed one must be left untouched */
+static void check_window(const struct kernels *k, unsigned int n)
+{
+	static double ref_d[MAX_SAMPLES * FFT_LANES], out_d[MAX_SAMPLES * FFT_LANES];
+	static float ref_f[MAX_SAMPLES * FFT_LANES], out_f[MAX_SAMPLES * FFT_LANES];
+	static int32_t ref_q[MAX_SAMPLES * FFT_LANES], out_q[MAX_SAMPLES * FFT_LANES];
+	double wave_d[MAX_SAMPLES], coefs_d[MAX_SAMPLES];
+	float wave_f[MAX_SAMPLES], coefs_f[MAX_SAMPLES];
+	int32_t wave_q[MAX_SAMPLES], coefs_q[MAX_SAMPLES];
+	unsigned int s, lane = check_rand() % FFT_LANES;
+
+	for (s = 0; s < n; s++) {
+		wave_d[s] = check_rand_unit();
+		coefs_d[s] = check_rand_unit();
+		wave_f[s] = wave_d[s];
+		coefs_f[s] = coefs_d[s];
+		wave_q[s] = check_rand();
+		coefs_q[s] = check_rand();
+	}
+
+	memset(ref_d, 0, sizeof(ref_d));
+	memset(out_d, 0, sizeof(out_d));
+	kernels_scalar.window_double(&ref_d[lane], wave_d, coefs_d, n);
+	k->window_double(&out_d[lane], wave_d, coefs_d, n);
+	check(!memcmp(ref_d, out_d, sizeof(ref_d)), k, "window_double", 1, 64, n);
+
+	memset(ref_f, 0, sizeof(ref_f));
+	memset(out_f, 0, sizeof(out_f));
+	kernels_scalar.window_float(&ref_f[lane], wave_f, coefs_f, n);
+	k->window_float(&out_f[lane], wave_f, coefs_f, n);
+	check(!memcmp(ref_f, out_f, sizeof(ref_f)), k, "window_float", 1, 32, n);
+
+	memset(ref_q, 0, sizeof(ref_q));
+	memset(out_q, 0, sizeof(out_q));
+	kernels_scalar.window_fixed(&ref_q[lane], wave_q, coefs_q, n);
+	k->window_fixed(&out_q[lane], wave_q, coefs_q, n);
+	check(!memcmp(ref_q, out_q, sizeof(ref_q)), k, "window_fixed", 1, 32, n);
+}
+
+static void check_power(const struct kernels *k, unsigned int size)
+{
+	static double re_d[MAX_POWER_SIZE * FFT_LANES], im_d[MAX_POWER_SIZE * FFT_LANES];
+	static float re_f[MAX_POWER_SIZE * FFT_LANES], im_f[MAX_POWER_SIZE * FFT_LANES];
+	static int32_t re_q[MAX_POWER_SIZE * FFT_LANES], im_q[MAX_POWER_SIZE * FFT_LANES];
+	static double ref_d[(MAX_POWER_SIZE / 2 + 1) * 2 * FFT_LANES];
+	static double out_d[(MAX_POWER_SIZE / 2 + 1) * 2 * FFT_LANES];
+	static float ref_f[(MAX_POWER_SIZE / 2 + 1) * 2 * FFT_LANES];
+	static float out_f[(MAX_POWER_SIZE / 2 + 1) * 2 * FFT_LANES];
+	static uint64_t ref_q[(MAX_POWER_SIZE / 2 + 1) * 2 * FFT_LANES];
+	static uint64_t out_q[(MAX_POWER_SIZE / 2 + 1) * 2 * FFT_LANES];
+	unsigned int i;
+
+	for (i = 0; i < size * FFT_LANES; i++) {
+		re_d[i] = check_rand_unit() * size;
+		im_d[i] = check_rand_unit() * size;
+		re_f[i] = re_d[i];
+		im_f[i] = im_d[i];
+		re_q[i] = check_rand();
+		im_q[i] = check_rand();
+	}
+
+	memset(ref_d, 0, sizeof(ref_d));
+	memset(out_d, 0, sizeof(out_d));
+	kernels_scalar.power_double(ref_d, re_d, im_d, size);
+	k->power_double(out_d, re_d, im_d, size);
+	check(!memcmp(ref_d, out_d, sizeof(ref_d)), k, "power_double", 1, 64,
+	      size);
+
+	memset(ref_f, 0, sizeof(ref_f));
+	memset(out_f, 0, sizeof(out_f));
+	kernels_scalar.power_float(ref_f, re_f, im_f, size);
+	k->power_float(out_f, re_f, im_f, size);
+	check(!memcmp(ref_f, out_f, sizeof(ref_f)), k, "power_float", 1, 32,
+	      size);
+
+	memset(ref_q, 0, sizeof(ref_q));
+	memset(out_q, 0, sizeof(out_q));
+	kernels_scalar.power_fixed(ref_q, re_q, im_q, size);
+	k->power_fixed(out_q, re_q, im_q, size);
+	check(!memcmp(ref_q, out_q, sizeof(ref_q)), k, "power_fixed", 1, 32,
+	      size);
+}
+
+static void check_pcm(const struct kernels *k, unsigned int channels,
+		      unsigned int bits, unsigned int n)
+{
+	static double samples[MAX_CHANNELS][MAX_SAMPLES];
+	size_t len = (size_t)n * channels * bits / 8;
+	double *waves[MAX_CHANNELS];
+	uint8_t *ref, *out;
+	unsigned int c, s;
+
+	for (c = 0; c < channels; c++) {
+		waves[c] = samples[c];
+		for (s = 0; s < n; s++)
+			samples[c][s] = check_rand_unit();
+	}
+
+	/* Full scale samples must not wrap around */
+	if (n)
+		samples[0][0] = 1;
+	if (n > 1)
+		samples[channels - 1][n - 1] = -1;
+
+	ref = calloc(len + 1, 1);
+	out = calloc(len + 1, 1);
+	if (!ref || !out)
+		exit(EXIT_FAILURE);
+
+	kernels_scalar.pcm_from_double(ref, waves, channels, bits, n);
+	k->pcm_from_double(out, waves, channels, bits, n);
+	check(!memcmp(ref, out, len + 1), k, "pcm_from_double", channels, bits,
+	      n);
+
+	free(ref);
+	free(out);
+}
+
+int main(void)
+{
+	const struct kernels *k;
+	unsigned int i, b, c, n, size, failed;
+
+	for (i = 0; i < kernels_count; i++) {
+		k = kernels_list[i];
+		if (k == &kernels_scalar)
+			continue;
+
+		if (k->supported && !k->supported()) {
+			printf("%s: not supported by this CPU, skipped\n", k->name);
+			continue;
+		}
+
+		failed = failures;
+		for (b = 0; b < sizeof(bit_depths) / sizeof(*bit_depths); b++) {
+			for (c = 1; c <= MAX_CHANNELS; c++) {
+				for (n = 0; n < MAX_SAMPLES; n++) {
+					check_unpack(k, c, bit_depths[b], n);
+					check_pcm(k, c, bit_depths[b], n);
+				}
+			}
+
+			for (n = 0; n < MAX_SAMPLES; n++)
+				check_convert(k, bit_depths[b], n);
+		}
+
+		for (n = 0; n < MAX_SAMPLES; n++)
+			check_window(k, n);
+
+		for (size = 2; size <= MAX_POWER_SIZE; size *= 2)
+			check_power(k, size);
+
+		printf("%s: %s\n", k->name, failures > failed ? "FAILED" : "ok");
+	}
+
+	return failures ? EXIT_FAILURE : EXIT_SUCCESS;
+}
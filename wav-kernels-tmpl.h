@@ -0,0 +1,65 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Precision dependent scalar kernels, included by wav-kernels.c once per
+ * precision with:
+ * - SAMPLE_T: the type of the samples
+ * - POWER_T: the type of the power distribution
+ * - SAMPLE_FN(): suffixes names with the precision
+ * - SAMPLE_FROM_INT(): converts a raw sample with a scale
+ * - SAMPLE_ABS(): absolute value of a sample
+ * - SAMPLE_WINDOW(): applies a window coefficient to a sample
+ * - SAMPLE_POWER(): power of a bin out of X[k], X[N - k], Y[k], Y[N - k]
+ */
+
+static SAMPLE_T SAMPLE_FN(convert_scalar)(SAMPLE_T *wave, const int32_t *raw,
+					  SAMPLE_T scale, unsigned int n)
+{
+	SAMPLE_T peak = 0;
+	unsigned int s;
+
+	for (s = 0; s < n; s++) {
+		wave[s] = SAMPLE_FROM_INT(raw[s], scale);
+		if (SAMPLE_ABS(wave[s]) > peak)
+			peak = SAMPLE_ABS(wave[s]);
+	}
+
+	return peak;
+}
+
+static void SAMPLE_FN(window_scalar)(SAMPLE_T *lanes, const SAMPLE_T *wave,
+				     const SAMPLE_T *coefs, unsigned int n)
+{
+	unsigned int i;
+
+	for (i = 0; i < n; i++)
+		lanes[i * FFT_LANES] = SAMPLE_WINDOW(wave[i], coefs[i]);
+}
+
+/* Separate the spectra of the two real signals packed in each lane, thanks
+ * to the Hermitian symmetry of real signals' transforms, and extract their
+ * power:
+ * X[k] = (Z[k] + conj(Z[N - k])) / 2
+ * Y[k] = (Z[k] - conj(Z[N - k])) / 2i
+ * The DC and Nyquist bins are their own mirror.
+ */
+static void SAMPLE_FN(power_scalar)(POWER_T *power, const SAMPLE_T *re,
+				    const SAMPLE_T *im, unsigned int size)
+{
+	const SAMPLE_T *rk, *rnk, *ik, *ink;
+	unsigned int i, nk, l;
+	POWER_T *x, *y;
+
+	for (i = 0; i <= size / 2; i++) {
+		nk = (size - i) & (size - 1);
+		rk = &re[i * FFT_LANES];
+		ik = &im[i * FFT_LANES];
+		rnk = &re[nk * FFT_LANES];
+		ink = &im[nk * FFT_LANES];
+		x = &power[i * 2 * FFT_LANES];
+		y = x + FFT_LANES;
+		for (l = 0; l < FFT_LANES; l++) {
+			x[l] = SAMPLE_POWER(rk[l], rnk[l], ik[l], ink[l]);
+			y[l] = SAMPLE_POWER(ik[l], ink[l], rk[l], rnk[l]);
+		}
+	}
+}
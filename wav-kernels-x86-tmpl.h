@@ -0,0 +1,308 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * x86 SIMD kernels, included by wav-kernels.c once per instruction set with:
+ * - X86_FN(): suffixes names with the instruction set
+ * - VD_*: vectors of VD_N doubles
+ * - VF_*: vectors of VF_N floats
+ * - VI_*: vectors of VI_N 32-bit integers, VI_N being both VF_N and 2 * VD_N
+ * - VI_GATHER(): optional, loads 32-bit words at byte offsets from a base
+ * Each kernel ends with the scalar reference on the remaining samples and
+ * falls back to it entirely on unusual layouts.
+ */
+
+/* Mono and stereo S16/S32 layouts are deinterleaved with shuffles, S24 with
+ * gathers when available.
+ */
+static void X86_FN(unpack)(int32_t *raw, const uint8_t *buf, unsigned int chan,
+			   unsigned int channels, unsigned int bits,
+			   unsigned int n)
+{
+	const int16_t *buf_i16 = (const int16_t *)buf;
+	const int32_t *buf_i32 = (const int32_t *)buf;
+	unsigned int s = 0;
+	VI_T v;
+
+	if (bits == 16 && channels == 1) {
+		for (; s + VI_N <= n; s += VI_N)
+			VI_STORE(&raw[s], VI_LOAD_I16(&buf_i16[s]));
+	} else if (bits == 16 && channels == 2) {
+		/* Each frame is a 32-bit word, sign extend the right half */
+		for (; s + VI_N <= n; s += VI_N) {
+			v = VI_LOAD(&buf_i16[2 * s]);
+			if (!chan)
+				v = VI_SLLI(v, 16);
+			VI_STORE(&raw[s], VI_SRAI(v, 16));
+		}
+	} else if (bits == 32 && channels == 1) {
+		for (; s + VI_N <= n; s += VI_N)
+			VI_STORE(&raw[s], VI_LOAD(&buf_i32[s]));
+	} else if (bits == 32 && channels == 2) {
+		for (; s + VI_N <= n; s += VI_N)
+			VI_STORE(&raw[s], VI_UNZIP(VI_LOAD(&buf_i32[2 * s]),
+						   VI_LOAD(&buf_i32[2 * s + VI_N]),
+						   chan));
+	}
+#ifdef VI_GATHER
+	else if (bits == 24) {
+		/* Load a 32-bit word at each sample and sign extend its 3 lower
+		 * bytes. The last frame is left to the scalar code in order not
+		 * to read past the end of the buffer.
+		 */
+		int32_t offsets[VI_N];
+		unsigned int i;
+		VI_T idx;
+
+		for (i = 0; i < VI_N; i++)
+			offsets[i] = (i * channels + chan) * 3;
+		idx = VI_LOAD(offsets);
+
+		for (; s + VI_N < n; s += VI_N) {
+			v = VI_GATHER(buf + s * channels * 3, idx);
+			VI_STORE(&raw[s], VI_SRAI(VI_SLLI(v, 8), 8));
+		}
+	}
+#endif
+
+	if (s < n)
+		unpack_scalar(&raw[s], buf + (s * channels * bits / 8), chan,
+			      channels, bits, n - s);
+}
+
+static double X86_FN(convert_double)(double *wave, const int32_t *raw,
+				     double scale, unsigned int n)
+{
+	VD_T vscale = VD_SET1(scale), vpeak = VD_SET1(0), w;
+	double peaks[VD_N], peak = 0;
+	unsigned int s, i;
+
+	for (s = 0; s + VD_N <= n; s += VD_N) {
+		w = VD_DIV(VD_FROM_I32(&raw[s]), vscale);
+		VD_STORE(&wave[s], w);
+		vpeak = VD_MAX(vpeak, VD_ABS(w));
+	}
+
+	VD_STORE(peaks, vpeak);
+	for (i = 0; i < VD_N; i++)
+		peak = fmax(peak, peaks[i]);
+
+	if (s < n)
+		peak = fmax(peak, convert_scalar_double(&wave[s], &raw[s], scale,
+							n - s));
+
+	return peak;
+}
+
+static float X86_FN(convert_float)(float *wave, const int32_t *raw,
+				   float scale, unsigned int n)
+{
+	VF_T vscale = VF_SET1(scale), vpeak = VF_SET1(0), w;
+	float peaks[VF_N], peak = 0;
+	unsigned int s, i;
+
+	for (s = 0; s + VF_N <= n; s += VF_N) {
+		w = VF_DIV(VF_FROM_I32(&raw[s]), vscale);
+		VF_STORE(&wave[s], w);
+		vpeak = VF_MAX(vpeak, VF_ABS(w));
+	}
+
+	VF_STORE(peaks, vpeak);
+	for (i = 0; i < VF_N; i++)
+		peak = fmaxf(peak, peaks[i]);
+
+	if (s < n)
+		peak = fmaxf(peak, convert_scalar_float(&wave[s], &raw[s], scale,
+							n - s));
+
+	return peak;
+}
+
+static int32_t X86_FN(convert_fixed)(int32_t *wave, const int32_t *raw,
+				     int32_t scale, unsigned int n)
+{
+	VI_T vpeak = VI_SET1(0), w;
+	int32_t peaks[VI_N], peak = 0, tail;
+	unsigned int s, i;
+
+	for (s = 0; s + VI_N <= n; s += VI_N) {
+		w = VI_SLL(VI_LOAD(&raw[s]), scale);
+		VI_STORE(&wave[s], w);
+		/* x ^ (x >> 31) is ~x for negative values, like SAMPLE_ABS() */
+		vpeak = VI_MAX(vpeak, VI_XOR(w, VI_SRAI(w, 31)));
+	}
+
+	VI_STORE(peaks, vpeak);
+	for (i = 0; i < VI_N; i++)
+		if (peaks[i] > peak)
+			peak = peaks[i];
+
+	if (s < n) {
+		tail = convert_scalar_fixed(&wave[s], &raw[s], scale, n - s);
+		if (tail > peak)
+			peak = tail;
+	}
+
+	return peak;
+}
+
+/* The lanes of a batch are interleaved, scatter the windowed samples */
+static void X86_FN(window_double)(double *lanes, const double *wave,
+				  const double *coefs, unsigned int n)
+{
+	double w[VD_N];
+	unsigned int i, j;
+
+	for (i = 0; i + VD_N <= n; i += VD_N) {
+		VD_STORE(w, VD_MUL(VD_LOAD(&wave[i]), VD_LOAD(&coefs[i])));
+		for (j = 0; j < VD_N; j++)
+			lanes[(i + j) * FFT_LANES] = w[j];
+	}
+
+	if (i < n)
+		window_scalar_double(&lanes[i * FFT_LANES], &wave[i], &coefs[i],
+				     n - i);
+}
+
+static void X86_FN(window_float)(float *lanes, const float *wave,
+				 const float *coefs, unsigned int n)
+{
+	float w[VF_N];
+	unsigned int i, j;
+
+	for (i = 0; i + VF_N <= n; i += VF_N) {
+		VF_STORE(w, VF_MUL(VF_LOAD(&wave[i]), VF_LOAD(&coefs[i])));
+		for (j = 0; j < VF_N; j++)
+			lanes[(i + j) * FFT_LANES] = w[j];
+	}
+
+	if (i < n)
+		window_scalar_float(&lanes[i * FFT_LANES], &wave[i], &coefs[i],
+				    n - i);
+}
+
+/* The lanes of a bin are contiguous, vectorize across lanes when they fill
+ * at least one vector.
+ */
+#if VD_N <= FFT_LANES
+static void X86_FN(power_double)(double *power, const double *re,
+				 const double *im, unsigned int size)
+{
+	VD_T rk, rnk, ik, ink, a, b, half = VD_SET1(0.5);
+	unsigned int i, nk, l;
+	double *x, *y;
+
+	for (i = 0; i <= size / 2; i++) {
+		nk = (size - i) & (size - 1);
+		x = &power[i * 2 * FFT_LANES];
+		y = x + FFT_LANES;
+		for (l = 0; l < FFT_LANES; l += VD_N) {
+			rk = VD_LOAD(&re[i * FFT_LANES + l]);
+			ik = VD_LOAD(&im[i * FFT_LANES + l]);
+			rnk = VD_LOAD(&re[nk * FFT_LANES + l]);
+			ink = VD_LOAD(&im[nk * FFT_LANES + l]);
+
+			a = VD_ADD(rk, rnk);
+			b = VD_SUB(ik, ink);
+			VD_STORE(&x[l], VD_MUL(VD_SQRT(VD_ADD(VD_MUL(a, a),
+							      VD_MUL(b, b))),
+					       half));
+
+			a = VD_ADD(ik, ink);
+			b = VD_SUB(rk, rnk);
+			VD_STORE(&y[l], VD_MUL(VD_SQRT(VD_ADD(VD_MUL(a, a),
+							      VD_MUL(b, b))),
+					       half));
+		}
+	}
+}
+#endif
+
+#if VF_N <= FFT_LANES
+static void X86_FN(power_float)(float *power, const float *re,
+				const float *im, unsigned int size)
+{
+	VF_T rk, rnk, ik, ink, a, b, half = VF_SET1(0.5f);
+	unsigned int i, nk, l;
+	float *x, *y;
+
+	for (i = 0; i <= size / 2; i++) {
+		nk = (size - i) & (size - 1);
+		x = &power[i * 2 * FFT_LANES];
+		y = x + FFT_LANES;
+		for (l = 0; l < FFT_LANES; l += VF_N) {
+			rk = VF_LOAD(&re[i * FFT_LANES + l]);
+			ik = VF_LOAD(&im[i * FFT_LANES + l]);
+			rnk = VF_LOAD(&re[nk * FFT_LANES + l]);
+			ink = VF_LOAD(&im[nk * FFT_LANES + l]);
+
+			a = VF_ADD(rk, rnk);
+			b = VF_SUB(ik, ink);
+			VF_STORE(&x[l], VF_MUL(VF_SQRT(VF_ADD(VF_MUL(a, a),
+							      VF_MUL(b, b))),
+					       half));
+
+			a = VF_ADD(ik, ink);
+			b = VF_SUB(rk, rnk);
+			VF_STORE(&y[l], VF_MUL(VF_SQRT(VF_ADD(VF_MUL(a, a),
+							      VF_MUL(b, b))),
+					       half));
+		}
+	}
+}
+#endif
+
+/* Mono and stereo S16/S32 layouts are interleaved with shuffles, other
+ * channel counts are converted with vectors and stored one by one.
+ */
+static void X86_FN(pcm_from_double)(uint8_t *buf, double *const *waves,
+				    unsigned int channels, unsigned int bits,
+				    unsigned int n)
+{
+	VD_T full = VD_SET1(bits == 16 ? INT16_MAX : INT32_MAX);
+	int16_t *buf_i16 = (int16_t *)buf;
+	int32_t *buf_i32 = (int32_t *)buf;
+	double *tails[channels];
+	int32_t samples[VI_N];
+	unsigned int s = 0, c, i;
+	VI_T v[2], lo, hi;
+
+	if (bits == 16 || bits == 32) {
+		for (; s + VI_N <= n; s += VI_N) {
+			for (c = 0; c < channels; c++) {
+				v[c % 2] = VI_FROM_VD2(VD_MUL(VD_LOAD(&waves[c][s]), full),
+						       VD_MUL(VD_LOAD(&waves[c][s + VD_N]), full));
+				if (channels <= 2)
+					continue;
+
+				VI_STORE(samples, v[c % 2]);
+				for (i = 0; i < VI_N; i++) {
+					if (bits == 16)
+						buf_i16[(s + i) * channels + c] = samples[i];
+					else
+						buf_i32[(s + i) * channels + c] = samples[i];
+				}
+			}
+
+			if (channels == 1 && bits == 16) {
+				VI_STORE_I16(&buf_i16[s], v[0]);
+			} else if (channels == 1) {
+				VI_STORE(&buf_i32[s], v[0]);
+			} else if (channels == 2 && bits == 16) {
+				/* Pack both channels in 32-bit frames */
+				VI_STORE(&buf_i16[2 * s],
+					 VI_OR(VI_SLLI(v[1], 16),
+					       VI_AND(v[0], VI_SET1(0xFFFF))));
+			} else if (channels == 2) {
+				VI_ZIP(v[0], v[1], &lo, &hi);
+				VI_STORE(&buf_i32[2 * s], lo);
+				VI_STORE(&buf_i32[2 * s + VI_N], hi);
+			}
+		}
+	}
+
+	if (s < n) {
+		for (c = 0; c < channels; c++)
+			tails[c] = &waves[c][s];
+		pcm_from_double_scalar(buf + (s * channels * bits / 8), tails,
+				       channels, bits, n - s);
+	}
+}
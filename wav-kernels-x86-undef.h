@@ -0,0 +1,48 @@
+// SPDX-License-Identifier: GPL-2.0+
+/* Undefines the macros of an instantiation of wav-kernels-x86-tmpl.h */
+
+#undef X86_FN
+#undef VD_T
+#undef VD_N
+#undef VD_LOAD
+#undef VD_STORE
+#undef VD_SET1
+#undef VD_ADD
+#undef VD_SUB
+#undef VD_MUL
+#undef VD_DIV
+#undef VD_MAX
+#undef VD_SQRT
+#undef VD_ABS
+#undef VD_FROM_I32
+#undef VF_T
+#undef VF_N
+#undef VF_LOAD
+#undef VF_STORE
+#undef VF_SET1
+#undef VF_ADD
+#undef VF_SUB
+#undef VF_MUL
+#undef VF_DIV
+#undef VF_MAX
+#undef VF_SQRT
+#undef VF_ABS
+#undef VF_FROM_I32
+#undef VI_T
+#undef VI_N
+#undef VI_LOAD
+#undef VI_STORE
+#undef VI_SET1
+#undef VI_SLLI
+#undef VI_SRAI
+#undef VI_SLL
+#undef VI_AND
+#undef VI_OR
+#undef VI_XOR
+#undef VI_MAX
+#undef VI_LOAD_I16
+#undef VI_STORE_I16
+#undef VI_FROM_VD2
+#undef VI_ZIP
+#undef VI_UNZIP
+#undef VI_GATHER
@@ -0,0 +1,500 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+
+#include "wav-lib.h"
+#include "wav-fft.h"
+#include "wav-kernels.h"
+
+static void unpack_scalar(int32_t *raw, const uint8_t *buf, unsigned int chan,
+			  unsigned int channels, unsigned int bits,
+			  unsigned int n)
+{
+	const int16_t *buf_i16 = (const int16_t *)buf;
+	const int24_t *buf_i24 = (const int24_t *)buf;
+	const int32_t *buf_i32 = (const int32_t *)buf;
+	unsigned int s;
+
+	switch (bits) {
+	case 16:
+		for (s = 0; s < n; s++)
+			raw[s] = buf_i16[(channels * s) + chan];
+		break;
+	case 24:
+		for (s = 0; s < n; s++)
+			raw[s] = i24_to_i32(buf_i24[(channels * s) + chan]);
+		break;
+	case 32:
+		for (s = 0; s < n; s++)
+			raw[s] = buf_i32[(channels * s) + chan];
+		break;
+	default:
+		break;
+	};
+}
+
+static void pcm_from_double_scalar(uint8_t *buf, double *const *waves,
+				   unsigned int channels, unsigned int bits,
+				   unsigned int n)
+{
+	int16_t *buf_i16 = (int16_t *)buf;
+	int24_t *buf_i24 = (int24_t *)buf;
+	int32_t *buf_i32 = (int32_t *)buf;
+	unsigned int s, c;
+
+	switch (bits) {
+	case 16:
+		for (s = 0; s < n; s++)
+			for (c = 0; c < channels; c++)
+				buf_i16[(s * channels) + c] = waves[c][s] * INT16_MAX;
+		break;
+	case 24:
+		for (s = 0; s < n; s++)
+			for (c = 0; c < channels; c++)
+				buf_i24[(s * channels) + c] =
+					i32_to_i24((int32_t)(waves[c][s] * 0x7FFFFF));
+		break;
+	case 32:
+		for (s = 0; s < n; s++)
+			for (c = 0; c < channels; c++)
+				buf_i32[(s * channels) + c] = waves[c][s] * INT32_MAX;
+		break;
+	default:
+		break;
+	};
+}
+
+#define SAMPLE_T double
+#define POWER_T double
+#define SAMPLE_FN(name) name##_double
+#define SAMPLE_FROM_INT(sample, scale) ((sample) / (scale))
+#define SAMPLE_ABS(x) fabs(x)
+#define SAMPLE_WINDOW(x, coef) ((x) * (coef))
+#define SAMPLE_POWER(xk, xnk, yk, ynk) \
+	(sqrt(((xk) + (xnk)) * ((xk) + (xnk)) + ((yk) - (ynk)) * ((yk) - (ynk))) / 2)
+#include "wav-kernels-tmpl.h"
+#undef SAMPLE_T
+#undef POWER_T
+#undef SAMPLE_FN
+#undef SAMPLE_FROM_INT
+#undef SAMPLE_ABS
+#undef SAMPLE_WINDOW
+#undef SAMPLE_POWER
+
+#define SAMPLE_T float
+#define POWER_T float
+#define SAMPLE_FN(name) name##_float
+#define SAMPLE_FROM_INT(sample, scale) ((sample) / (scale))
+#define SAMPLE_ABS(x) fabsf(x)
+#define SAMPLE_WINDOW(x, coef) ((x) * (coef))
+#define SAMPLE_POWER(xk, xnk, yk, ynk) \
+	(sqrtf(((xk) + (xnk)) * ((xk) + (xnk)) + ((yk) - (ynk)) * ((yk) - (ynk))) / 2)
+#include "wav-kernels-tmpl.h"
+#undef SAMPLE_T
+#undef POWER_T
+#undef SAMPLE_FN
+#undef SAMPLE_FROM_INT
+#undef SAMPLE_ABS
+#undef SAMPLE_WINDOW
+#undef SAMPLE_POWER
+
+/* Q31 fixed point: the raw samples are left aligned on 32 bits and the power
+ * distribution is a squared magnitude. The windowed samples are halved to
+ * leave some headroom to the FFT.
+ */
+static inline uint64_t q31_power(int32_t xk, int32_t xnk, int32_t yk, int32_t ynk)
+{
+	int64_t re = ((int64_t)xk + xnk) >> 1, im = ((int64_t)yk - ynk) >> 1;
+
+	return (uint64_t)(re * re) + (uint64_t)(im * im);
+}
+
+#define SAMPLE_T int32_t
+#define POWER_T uint64_t
+#define SAMPLE_FN(name) name##_fixed
+#define SAMPLE_FROM_INT(sample, scale) ((int32_t)((uint32_t)(sample) << (scale)))
+#define SAMPLE_ABS(x) ((x) < 0 ? ~(x) : (x))
+#define SAMPLE_WINDOW(x, coef) ((int32_t)(((int64_t)(x) * (coef)) >> 32))
+#define SAMPLE_POWER(xk, xnk, yk, ynk) q31_power(xk, xnk, yk, ynk)
+#include "wav-kernels-tmpl.h"
+#undef SAMPLE_T
+#undef POWER_T
+#undef SAMPLE_FN
+#undef SAMPLE_FROM_INT
+#undef SAMPLE_ABS
+#undef SAMPLE_WINDOW
+#undef SAMPLE_POWER
+
+const struct kernels kernels_scalar = {
+	.name = "scalar",
+	.unpack = unpack_scalar,
+	.convert_double = convert_scalar_double,
+	.convert_float = convert_scalar_float,
+	.convert_fixed = convert_scalar_fixed,
+	.window_double = window_scalar_double,
+	.window_float = window_scalar_float,
+	.window_fixed = window_scalar_fixed,
+	.power_double = power_scalar_double,
+	.power_float = power_scalar_float,
+	.power_fixed = power_scalar_fixed,
+	.pcm_from_double = pcm_from_double_scalar,
+};
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+
+/* Distributions ship a single binary, the SIMD flavours are compiled for
+ * their own instruction set and picked at runtime.
+ */
+#pragma GCC push_options
+#pragma GCC target("sse2")
+
+/* SSE2 lacks a signed 32-bit maximum */
+static inline __m128i max_epi32_sse2(__m128i a, __m128i b)
+{
+	__m128i gt = _mm_cmpgt_epi32(a, b);
+
+	return _mm_or_si128(_mm_and_si128(gt, a), _mm_andnot_si128(gt, b));
+}
+
+static inline __m128i unzip_sse2(__m128i a, __m128i b, unsigned int odd)
+{
+	__m128 fa = _mm_castsi128_ps(a), fb = _mm_castsi128_ps(b);
+
+	if (odd)
+		return _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1)));
+
+	return _mm_castps_si128(_mm_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0)));
+}
+
+static inline void zip_sse2(__m128i a, __m128i b, __m128i *lo, __m128i *hi)
+{
+	*lo = _mm_unpacklo_epi32(a, b);
+	*hi = _mm_unpackhi_epi32(a, b);
+}
+
+/* Sign extend 4 samples by duplicating them in the upper halves */
+static inline __m128i load_i16_sse2(const int16_t *p)
+{
+	__m128i v = _mm_loadl_epi64((const __m128i *)p);
+
+	return _mm_srai_epi32(_mm_unpacklo_epi16(v, v), 16);
+}
+
+#define X86_FN(name) name##_sse2
+#define VD_T __m128d
+#define VD_N 2
+#define VD_LOAD(p) _mm_loadu_pd(p)
+#define VD_STORE(p, v) _mm_storeu_pd(p, v)
+#define VD_SET1(x) _mm_set1_pd(x)
+#define VD_ADD(a, b) _mm_add_pd(a, b)
+#define VD_SUB(a, b) _mm_sub_pd(a, b)
+#define VD_MUL(a, b) _mm_mul_pd(a, b)
+#define VD_DIV(a, b) _mm_div_pd(a, b)
+#define VD_MAX(a, b) _mm_max_pd(a, b)
+#define VD_SQRT(v) _mm_sqrt_pd(v)
+#define VD_ABS(v) _mm_andnot_pd(_mm_set1_pd(-0.0), v)
+#define VD_FROM_I32(p) _mm_cvtepi32_pd(_mm_loadl_epi64((const __m128i *)(p)))
+#define VF_T __m128
+#define VF_N 4
+#define VF_LOAD(p) _mm_loadu_ps(p)
+#define VF_STORE(p, v) _mm_storeu_ps(p, v)
+#define VF_SET1(x) _mm_set1_ps(x)
+#define VF_ADD(a, b) _mm_add_ps(a, b)
+#define VF_SUB(a, b) _mm_sub_ps(a, b)
+#define VF_MUL(a, b) _mm_mul_ps(a, b)
+#define VF_DIV(a, b) _mm_div_ps(a, b)
+#define VF_MAX(a, b) _mm_max_ps(a, b)
+#define VF_SQRT(v) _mm_sqrt_ps(v)
+#define VF_ABS(v) _mm_andnot_ps(_mm_set1_ps(-0.0f), v)
+#define VF_FROM_I32(p) _mm_cvtepi32_ps(VI_LOAD(p))
+#define VI_T __m128i
+#define VI_N 4
+#define VI_LOAD(p) _mm_loadu_si128((const __m128i *)(p))
+#define VI_STORE(p, v) _mm_storeu_si128((__m128i *)(p), v)
+#define VI_SET1(x) _mm_set1_epi32(x)
+#define VI_SLLI(v, n) _mm_slli_epi32(v, n)
+#define VI_SRAI(v, n) _mm_srai_epi32(v, n)
+#define VI_SLL(v, n) _mm_sll_epi32(v, _mm_cvtsi32_si128(n))
+#define VI_AND(a, b) _mm_and_si128(a, b)
+#define VI_OR(a, b) _mm_or_si128(a, b)
+#define VI_XOR(a, b) _mm_xor_si128(a, b)
+#define VI_MAX(a, b) max_epi32_sse2(a, b)
+#define VI_LOAD_I16(p) load_i16_sse2(p)
+#define VI_STORE_I16(p, v) _mm_storel_epi64((__m128i *)(p), _mm_packs_epi32(v, v))
+#define VI_FROM_VD2(a, b) _mm_unpacklo_epi64(_mm_cvttpd_epi32(a), _mm_cvttpd_epi32(b))
+#define VI_ZIP(a, b, lo, hi) zip_sse2(a, b, lo, hi)
+#define VI_UNZIP(a, b, odd) unzip_sse2(a, b, odd)
+#include "wav-kernels-x86-tmpl.h"
+#include "wav-kernels-x86-undef.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx2")
+
+static inline __m256i unzip_avx2(__m256i a, __m256i b, unsigned int odd)
+{
+	__m256 fa = _mm256_castsi256_ps(a), fb = _mm256_castsi256_ps(b), v;
+
+	/* Shuffles stay within 128-bit halves, reorder them afterwards */
+	if (odd)
+		v = _mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(3, 1, 3, 1));
+	else
+		v = _mm256_shuffle_ps(fa, fb, _MM_SHUFFLE(2, 0, 2, 0));
+
+	return _mm256_permute4x64_epi64(_mm256_castps_si256(v),
+					_MM_SHUFFLE(3, 1, 2, 0));
+}
+
+static inline void zip_avx2(__m256i a, __m256i b, __m256i *lo, __m256i *hi)
+{
+	__m256i l = _mm256_unpacklo_epi32(a, b), h = _mm256_unpackhi_epi32(a, b);
+
+	*lo = _mm256_permute2x128_si256(l, h, 0x20);
+	*hi = _mm256_permute2x128_si256(l, h, 0x31);
+}
+
+static inline void store_i16_avx2(int16_t *p, __m256i v)
+{
+	v = _mm256_permute4x64_epi64(_mm256_packs_epi32(v, v),
+				     _MM_SHUFFLE(0, 0, 2, 0));
+	_mm_storeu_si128((__m128i *)p, _mm256_castsi256_si128(v));
+}
+
+#define X86_FN(name) name##_avx2
+#define VD_T __m256d
+#define VD_N 4
+#define VD_LOAD(p) _mm256_loadu_pd(p)
+#define VD_STORE(p, v) _mm256_storeu_pd(p, v)
+#define VD_SET1(x) _mm256_set1_pd(x)
+#define VD_ADD(a, b) _mm256_add_pd(a, b)
+#define VD_SUB(a, b) _mm256_sub_pd(a, b)
+#define VD_MUL(a, b) _mm256_mul_pd(a, b)
+#define VD_DIV(a, b) _mm256_div_pd(a, b)
+#define VD_MAX(a, b) _mm256_max_pd(a, b)
+#define VD_SQRT(v) _mm256_sqrt_pd(v)
+#define VD_ABS(v) _mm256_andnot_pd(_mm256_set1_pd(-0.0), v)
+#define VD_FROM_I32(p) _mm256_cvtepi32_pd(_mm_loadu_si128((const __m128i *)(p)))
+#define VF_T __m256
+#define VF_N 8
+#define VF_LOAD(p) _mm256_loadu_ps(p)
+#define VF_STORE(p, v) _mm256_storeu_ps(p, v)
+#define VF_SET1(x) _mm256_set1_ps(x)
+#define VF_ADD(a, b) _mm256_add_ps(a, b)
+#define VF_SUB(a, b) _mm256_sub_ps(a, b)
+#define VF_MUL(a, b) _mm256_mul_ps(a, b)
+#define VF_DIV(a, b) _mm256_div_ps(a, b)
+#define VF_MAX(a, b) _mm256_max_ps(a, b)
+#define VF_SQRT(v) _mm256_sqrt_ps(v)
+#define VF_ABS(v) _mm256_andnot_ps(_mm256_set1_ps(-0.0f), v)
+#define VF_FROM_I32(p) _mm256_cvtepi32_ps(VI_LOAD(p))
+#define VI_T __m256i
+#define VI_N 8
+#define VI_LOAD(p) _mm256_loadu_si256((const __m256i *)(p))
+#define VI_STORE(p, v) _mm256_storeu_si256((__m256i *)(p), v)
+#define VI_SET1(x) _mm256_set1_epi32(x)
+#define VI_SLLI(v, n) _mm256_slli_epi32(v, n)
+#define VI_SRAI(v, n) _mm256_srai_epi32(v, n)
+#define VI_SLL(v, n) _mm256_sll_epi32(v, _mm_cvtsi32_si128(n))
+#define VI_AND(a, b) _mm256_and_si256(a, b)
+#define VI_OR(a, b) _mm256_or_si256(a, b)
+#define VI_XOR(a, b) _mm256_xor_si256(a, b)
+#define VI_MAX(a, b) _mm256_max_epi32(a, b)
+#define VI_LOAD_I16(p) _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(p)))
+#define VI_STORE_I16(p, v) store_i16_avx2(p, v)
+#define VI_FROM_VD2(a, b) \
+	_mm256_inserti128_si256(_mm256_castsi128_si256(_mm256_cvttpd_epi32(a)), \
+				_mm256_cvttpd_epi32(b), 1)
+#define VI_ZIP(a, b, lo, hi) zip_avx2(a, b, lo, hi)
+#define VI_UNZIP(a, b, odd) unzip_avx2(a, b, odd)
+#define VI_GATHER(base, idx) _mm256_i32gather_epi32((const int *)(base), idx, 1)
+#include "wav-kernels-x86-tmpl.h"
+#include "wav-kernels-x86-undef.h"
+#pragma GCC pop_options
+
+#pragma GCC push_options
+#pragma GCC target("avx512f,avx512bw,avx512vl")
+
+static inline __m512i unzip_avx512(__m512i a, __m512i b, unsigned int odd)
+{
+	__m512i idx = _mm512_setr_epi32(0, 2, 4, 6, 8, 10, 12, 14,
+					16, 18, 20, 22, 24, 26, 28, 30);
+
+	return _mm512_permutex2var_epi32(a, _mm512_add_epi32(idx, _mm512_set1_epi32(odd)), b);
+}
+
+static inline void zip_avx512(__m512i a, __m512i b, __m512i *lo, __m512i *hi)
+{
+	__m512i idx = _mm512_setr_epi32(0, 16, 1, 17, 2, 18, 3, 19,
+					4, 20, 5, 21, 6, 22, 7, 23);
+
+	*lo = _mm512_permutex2var_epi32(a, idx, b);
+	*hi = _mm512_permutex2var_epi32(a, _mm512_add_epi32(idx, _mm512_set1_epi32(8)), b);
+}
+
+#define X86_FN(name) name##_avx512
+#define VD_T __m512d
+#define VD_N 8
+#define VD_LOAD(p) _mm512_loadu_pd(p)
+#define VD_STORE(p, v) _mm512_storeu_pd(p, v)
+#define VD_SET1(x) _mm512_set1_pd(x)
+#define VD_ADD(a, b) _mm512_add_pd(a, b)
+#define VD_SUB(a, b) _mm512_sub_pd(a, b)
+#define VD_MUL(a, b) _mm512_mul_pd(a, b)
+#define VD_DIV(a, b) _mm512_div_pd(a, b)
+#define VD_MAX(a, b) _mm512_max_pd(a, b)
+#define VD_SQRT(v) _mm512_sqrt_pd(v)
+#define VD_ABS(v) _mm512_abs_pd(v)
+#define VD_FROM_I32(p) _mm512_cvtepi32_pd(_mm256_loadu_si256((const __m256i *)(p)))
+#define VF_T __m512
+#define VF_N 16
+#define VF_LOAD(p) _mm512_loadu_ps(p)
+#define VF_STORE(p, v) _mm512_storeu_ps(p, v)
+#define VF_SET1(x) _mm512_set1_ps(x)
+#define VF_ADD(a, b) _mm512_add_ps(a, b)
+#define VF_SUB(a, b) _mm512_sub_ps(a, b)
+#define VF_MUL(a, b) _mm512_mul_ps(a, b)
+#define VF_DIV(a, b) _mm512_div_ps(a, b)
+#define VF_MAX(a, b) _mm512_max_ps(a, b)
+#define VF_SQRT(v) _mm512_sqrt_ps(v)
+#define VF_ABS(v) _mm512_abs_ps(v)
+#define VF_FROM_I32(p) _mm512_cvtepi32_ps(VI_LOAD(p))
+#define VI_T __m512i
+#define VI_N 16
+#define VI_LOAD(p) _mm512_loadu_si512(p)
+#define VI_STORE(p, v) _mm512_storeu_si512(p, v)
+#define VI_SET1(x) _mm512_set1_epi32(x)
+#define VI_SLLI(v, n) _mm512_slli_epi32(v, n)
+#define VI_SRAI(v, n) _mm512_srai_epi32(v, n)
+#define VI_SLL(v, n) _mm512_sll_epi32(v, _mm_cvtsi32_si128(n))
+#define VI_AND(a, b) _mm512_and_si512(a, b)
+#define VI_OR(a, b) _mm512_or_si512(a, b)
+#define VI_XOR(a, b) _mm512_xor_si512(a, b)
+#define VI_MAX(a, b) _mm512_max_epi32(a, b)
+#define VI_LOAD_I16(p) _mm512_cvtepi16_epi32(_mm256_loadu_si256((const __m256i *)(p)))
+#define VI_STORE_I16(p, v) _mm256_storeu_si256((__m256i *)(p), _mm512_cvtsepi32_epi16(v))
+#define VI_FROM_VD2(a, b) \
+	_mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvttpd_epi32(a)), \
+			   _mm512_cvttpd_epi32(b), 1)
+#define VI_ZIP(a, b, lo, hi) zip_avx512(a, b, lo, hi)
+#define VI_UNZIP(a, b, odd) unzip_avx512(a, b, odd)
+#define VI_GATHER(base, idx) _mm512_i32gather_epi32(idx, base, 1)
+#include "wav-kernels-x86-tmpl.h"
+#include "wav-kernels-x86-undef.h"
+#pragma GCC pop_options
+
+static int sse2_supported(void)
+{
+	return __builtin_cpu_supports("sse2");
+}
+
+static int avx2_supported(void)
+{
+	return __builtin_cpu_supports("avx2");
+}
+
+static int avx512_supported(void)
+{
+	return __builtin_cpu_supports("avx512f") &&
+	       __builtin_cpu_supports("avx512bw") &&
+	       __builtin_cpu_supports("avx512vl");
+}
+
+/* The power kernels work across the FFT_LANES lanes of a bin, wider vectors
+ * reuse the narrower flavours. The fixed point window/power stay scalar.
+ */
+static const struct kernels kernels_sse2 = {
+	.name = "sse2",
+	.supported = sse2_supported,
+	.unpack = unpack_sse2,
+	.convert_double = convert_double_sse2,
+	.convert_float = convert_float_sse2,
+	.convert_fixed = convert_fixed_sse2,
+	.window_double = window_double_sse2,
+	.window_float = window_float_sse2,
+	.window_fixed = window_scalar_fixed,
+	.power_double = power_double_sse2,
+	.power_float = power_float_sse2,
+	.power_fixed = power_scalar_fixed,
+	.pcm_from_double = pcm_from_double_sse2,
+};
+
+static const struct kernels kernels_avx2 = {
+	.name = "avx2",
+	.supported = avx2_supported,
+	.unpack = unpack_avx2,
+	.convert_double = convert_double_avx2,
+	.convert_float = convert_float_avx2,
+	.convert_fixed = convert_fixed_avx2,
+	.window_double = window_double_avx2,
+	.window_float = window_float_avx2,
+	.window_fixed = window_scalar_fixed,
+	.power_double = power_double_avx2,
+	.power_float = power_float_sse2,
+	.power_fixed = power_scalar_fixed,
+	.pcm_from_double = pcm_from_double_avx2,
+};
+
+static const struct kernels kernels_avx512 = {
+	.name = "avx512",
+	.supported = avx512_supported,
+	.unpack = unpack_avx512,
+	.convert_double = convert_double_avx512,
+	.convert_float = convert_float_avx512,
+	.convert_fixed = convert_fixed_avx512,
+	.window_double = window_double_avx512,
+	.window_float = window_float_avx512,
+	.window_fixed = window_scalar_fixed,
+	.power_double = power_double_avx2,
+	.power_float = power_float_sse2,
+	.power_fixed = power_scalar_fixed,
+	.pcm_from_double = pcm_from_double_avx512,
+};
+
+#endif
+
+/* Available kernels, by order of preference */
+const struct kernels *const kernels_list[] = {
+#if defined(__x86_64__) || defined(__i386__)
+	&kernels_avx512,
+	&kernels_avx2,
+	&kernels_sse2,
+#endif
+	&kernels_scalar,
+};
+
+const unsigned int kernels_count = sizeof(kernels_list) / sizeof(*kernels_list);
+
+const struct kernels *kernels = &kernels_scalar;
+
+int kernels_init(void)
+{
+	const char *name = getenv(KERNELS_ENV);
+	const struct kernels *k;
+	unsigned int i;
+
+	for (i = 0; i < kernels_count; i++) {
+		k = kernels_list[i];
+		if (name && strcmp(name, k->name))
+			continue;
+
+		if (k->supported && !k->supported()) {
+			if (!name)
+				continue;
+
+			fprintf(stderr, "%s kernels not supported by this CPU\n", name);
+			return -1;
+		}
+
+		kernels = k;
+		return 0;
+	}
+
+	fprintf(stderr, "Unknown kernels: %s\n", name);
+
+	return -1;
+}
@@ -0,0 +1,63 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2023 Bootlin
+ * Author: Miquel Raynal <miquel.raynal@bootlin.com>
+ */
+
+/*
+ * Hot loops of the generator and of the analyzer. A scalar reference is
+ * always built, SIMD flavours are compiled in when the architecture has
+ * them and the best one supported by the CPU is selected at runtime. The
+ * KERNELS_ENV environment variable forces a flavour by name.
+ *
+ * - unpack: extracts n raw samples of a channel out of an interleaved
+ *   S16/S24/S32 buffer.
+ * - convert_*: converts raw samples with a scale (full scale value, or left
+ *   shift in fixed point) and returns the peak absolute value.
+ * - window_*: applies the window coefficients, lanes is the first sample of
+ *   a lane of a batch (see wav-fft.h), hence a stride of FFT_LANES.
+ * - power_*: separates the spectra of the 2 * FFT_LANES real signals of a
+ *   batch and saves the power distribution of each of them, interleaved:
+ *   power[bin * 2 * FFT_LANES + part * FFT_LANES + lane]
+ * - pcm_from_double: converts n samples of each wave in [-1; 1] into an
+ *   interleaved S16/S24/S32 buffer.
+ */
+
+#define KERNELS_ENV "WAV_TOOLS_SIMD"
+
+struct kernels {
+	const char *name;
+	/* Runtime check of the CPU features, NULL if always supported */
+	int (*supported)(void);
+	void (*unpack)(int32_t *raw, const uint8_t *buf, unsigned int chan,
+		       unsigned int channels, unsigned int bits, unsigned int n);
+	double (*convert_double)(double *wave, const int32_t *raw, double scale,
+				 unsigned int n);
+	float (*convert_float)(float *wave, const int32_t *raw, float scale,
+			       unsigned int n);
+	int32_t (*convert_fixed)(int32_t *wave, const int32_t *raw, int32_t scale,
+				 unsigned int n);
+	void (*window_double)(double *lanes, const double *wave,
+			      const double *coefs, unsigned int n);
+	void (*window_float)(float *lanes, const float *wave, const float *coefs,
+			     unsigned int n);
+	void (*window_fixed)(int32_t *lanes, const int32_t *wave,
+			     const int32_t *coefs, unsigned int n);
+	void (*power_double)(double *power, const double *re, const double *im,
+			     unsigned int size);
+	void (*power_float)(float *power, const float *re, const float *im,
+			    unsigned int size);
+	void (*power_fixed)(uint64_t *power, const int32_t *re, const int32_t *im,
+			    unsigned int size);
+	void (*pcm_from_double)(uint8_t *buf, double *const *waves,
+				unsigned int channels, unsigned int bits,
+				unsigned int n);
+};
+
+extern const struct kernels kernels_scalar;
+/* Kernels built in, by order of preference, the scalar reference last */
+extern const struct kernels *const kernels_list[];
+extern const unsigned int kernels_count;
+extern const struct kernels *kernels;
+
+int kernels_init(void);
@@ -1,7 +1,12 @@
 // SPDX-License-Identifier: GPL-2.0+
 
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
 
 #include "wav-lib.h"
 
@@ -10,7 +15,10 @@ void log_parameters(FILE *fd, const struct audio *wav)
 	fprintf(fd, "* Channels: %u\n", wav->channels);
 	fprintf(fd, "* Sample rate: %u Hz\n", wav->sample_rate);
 	fprintf(fd, "* Bits per sample: S%u_LE\n", wav->bits_per_sample);
-	fprintf(fd, "* Duration: %u seconds\n", wav->duration_s);
+	if (wav->samples_per_chan)
+		fprintf(fd, "* Duration: %u seconds\n", wav->duration_s);
+	else
+		fprintf(fd, "* Duration: unknown, until the end of the input\n");
 	if (wav->freqs_per_chan)
 		fprintf(fd, "* Frequencies per channel: %u\n", wav->freqs_per_chan);
 }
@@ -26,7 +34,7 @@ int fill_desired_freqs(unsigned int **freqs, const struct audio *wav)
 	delta_c = delta_f / (wav->channels + 1);
 
 	if (!delta_f || !delta_c) {
-		fprintf(stderr, "Cannot generate sine waves: not enough range\n");
+		fprintf(diag(), "Cannot generate sine waves: not enough range\n");
 		return -1;
 	}
 
@@ -37,12 +45,100 @@ int fill_desired_freqs(unsigned int **freqs, const struct audio *wav)
 	return 0;
 }
 
+static _Thread_local FILE *diag_file;
+
+FILE *diag(void)
+{
+	return diag_file ? diag_file : stderr;
+}
+
+FILE *diag_redirect(FILE *file)
+{
+	FILE *prev = diag_file;
+
+	diag_file = file;
+
+	return prev;
+}
+
+static atomic_size_t mem_used;
+static atomic_size_t mem_peak_used;
+
+/* Each accounted block starts with its size, keeping the alignment of
+ * malloc().
+ */
+#define MEM_HDR_SIZE sizeof(max_align_t)
+
+void *mem_alloc(size_t size)
+{
+	size_t used, peak;
+	uint8_t *block;
+
+	block = malloc(MEM_HDR_SIZE + size);
+	if (!block)
+		return NULL;
+
+	memcpy(block, &size, sizeof(size));
+	used = atomic_fetch_add(&mem_used, size) + size;
+	peak = atomic_load(&mem_peak_used);
+	while (used > peak &&
+	       !atomic_compare_exchange_weak(&mem_peak_used, &peak, used))
+		;
+
+	return block + MEM_HDR_SIZE;
+}
+
+void *mem_calloc(size_t nmemb, size_t size)
+{
+	void *ptr;
+
+	if (size && nmemb > SIZE_MAX / size)
+		return NULL;
+
+	ptr = mem_alloc(nmemb * size);
+	if (ptr)
+		memset(ptr, 0, nmemb * size);
+
+	return ptr;
+}
+
+void mem_free(void *ptr)
+{
+	uint8_t *block = ptr;
+	size_t size;
+
+	if (!ptr)
+		return;
+
+	block -= MEM_HDR_SIZE;
+	memcpy(&size, block, sizeof(size));
+	atomic_fetch_sub(&mem_used, size);
+	free(block);
+}
+
+size_t mem_peak(void)
+{
+	return atomic_load(&mem_peak_used);
+}
+
+void mem_report(FILE *fd)
+{
+	struct rusage usage;
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		usage.ru_maxrss = 0;
+
+	fprintf(fd, "Peak memory: heap %zu KiB, RSS %ld KiB\n",
+		(mem_peak() + 1023) / 1024, usage.ru_maxrss);
+}
+
+/* The rows of the matrices are accounted, not the arrays of pointers */
 void free_array(void **array, unsigned int n)
 {
 	unsigned int i;
 
 	for (i = 0; i < n; i++)
-		free(array[i]);
+		mem_free(array[i]);
 }
 
 void **alloc_matrix(unsigned int narrays, unsigned int nentries,
@@ -56,7 +152,7 @@ void **alloc_matrix(unsigned int narrays, unsigned int nentries,
 		return NULL;
 
 	for (i = 0; i < narrays; i++) {
-		matrix[i] = calloc(nentries, elem_size);
+		matrix[i] = mem_calloc(nentries, elem_size);
 		if (!matrix[i]) {
 			free_array(matrix, i);
 			free(matrix);
@@ -66,3 +162,80 @@ void **alloc_matrix(unsigned int narrays, unsigned int nentries,
 
 	return matrix;
 }
+
+static bool riff_tag_is(const char *tag, const char *name)
+{
+	return !memcmp(tag, name, 4);
+}
+
+static int riff_read_fmt(const struct riff_io *io, struct wav_format *wav_format,
+			 size_t len)
+{
+	struct wav_format_extensible ext;
+	size_t fmt_len = sizeof(*wav_format) - sizeof(struct data_container);
+
+	if (len < fmt_len || io->read(io->priv, wav_format, fmt_len) != fmt_len)
+		return -1;
+
+	len -= fmt_len;
+	if (wav_format->format_tag == WAVE_FORMAT_EXTENSIBLE) {
+		if (len < sizeof(ext) ||
+		    io->read(io->priv, &ext, sizeof(ext)) != sizeof(ext))
+			return -1;
+
+		len -= sizeof(ext);
+		wav_format->format_tag = ext.sub_format;
+	}
+
+	/* Skip cbSize and any extra format bytes, chunks are word aligned */
+	len += len % 2;
+	if (io->skip(io->priv, len) != len)
+		return -1;
+
+	return 0;
+}
+
+int riff_find_data(const struct riff_io *io, struct wav_format *wav_format)
+{
+	struct data_container chunk;
+	struct riff_container riff;
+	size_t hdr_len = offsetof(struct riff_container, wav_container) +
+			 sizeof(riff.wav_container.tag);
+	bool fmt = false;
+	size_t len;
+
+	if (io->read(io->priv, &riff, hdr_len) != hdr_len ||
+	    !riff_tag_is(riff.tag, "RIFF") ||
+	    !riff_tag_is(riff.wav_container.tag, "WAVE")) {
+		fprintf(diag(), "Malformed WAV file\n");
+		return -1;
+	}
+
+	while (io->read(io->priv, &chunk, sizeof(chunk)) == sizeof(chunk)) {
+		if (riff_tag_is(chunk.tag, "data")) {
+			if (!fmt)
+				break;
+
+			wav_format->data_container = chunk;
+			return 0;
+		}
+
+		if (riff_tag_is(chunk.tag, "fmt ")) {
+			if (riff_read_fmt(io, wav_format, chunk.chunk_size)) {
+				fprintf(diag(), "Malformed fmt chunk\n");
+				return -1;
+			}
+
+			fmt = true;
+			continue;
+		}
+
+		/* LIST, fact, etc. */
+		len = (size_t)chunk.chunk_size + chunk.chunk_size % 2;
+		if (io->skip(io->priv, len) != len)
+			break;
+	}
+
+	fprintf(diag(), "Malformed WAV file: no %s chunk\n", fmt ? "data" : "fmt");
+	return -1;
+}
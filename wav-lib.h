@@ -14,6 +14,7 @@
  */
 
 #define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_EXTENSIBLE 0xFFFE
 
 struct data_container {
 	char tag[4];
@@ -51,6 +52,32 @@ struct riff_container {
 	struct wav_container wav_container;
 } __attribute__((__packed__));
 
+/* Extension of a fmt chunk of WAVE_FORMAT_EXTENSIBLE, the actual format is
+ * given by the first two bytes of the sub format GUID.
+ */
+struct wav_format_extensible {
+	uint16_t cb_size;
+	uint16_t valid_bits_per_sample;
+	uint32_t channel_mask;
+	uint16_t sub_format;
+	uint8_t guid[14];
+} __attribute__((__packed__));
+
+/*
+ * Files from recorders carry more chunks (LIST, fact...) and may have a
+ * longer fmt chunk. riff_find_data() walks the chunks until the data one,
+ * filling the format with the fmt chunk found on the way and the header of
+ * the data chunk. Other chunks are skipped with skip(), which may avoid
+ * copying them.
+ */
+struct riff_io {
+	size_t (*read)(void *priv, void *buf, size_t len);
+	size_t (*skip)(void *priv, size_t len);
+	void *priv;
+};
+
+int riff_find_data(const struct riff_io *io, struct wav_format *wav_format);
+
 /* Shared functions and definitions */
 
 #define MIN_FREQ 200 /* Hz */
@@ -65,6 +92,26 @@ struct audio {
 	unsigned int samples_per_chan;
 };
 
+/*
+ * Accounted heap blocks: the big buffers of the tools (matrices, FFT
+ * workspaces and tables, I/O buffers) come from mem_alloc() and go back with
+ * mem_free(), mem_peak() tells the most they used at once.
+ */
+void *mem_alloc(size_t size);
+void *mem_calloc(size_t nmemb, size_t size);
+void mem_free(void *ptr);
+size_t mem_peak(void);
+/* One line summary of mem_peak() and of the peak resident set size */
+void mem_report(FILE *fd);
+
+/*
+ * Diagnostics of the calling thread: the standard error, unless redirected,
+ * eg. to answer the client of a daemon. diag_redirect() returns the previous
+ * stream, NULL standing for the standard error.
+ */
+FILE *diag(void);
+FILE *diag_redirect(FILE *file);
+
 void log_parameters(FILE *fd, const struct audio *wav);
 int fill_desired_freqs(unsigned int **freqs, const struct audio *wav);
 void free_array(void **array, unsigned int n);
@@ -0,0 +1,221 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "wav-pool.h"
+
+#define POOL_QUEUE_MIN 16
+
+/* Worker running the current thread, if any */
+static _Thread_local struct pool_worker *pool_self;
+
+static int queue_push(struct pool_queue *queue, const struct pool_task *task)
+{
+	struct pool_task *tasks;
+	unsigned int size, i;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if (queue->count == queue->size) {
+		size = queue->size ? 2 * queue->size : POOL_QUEUE_MIN;
+		tasks = malloc(size * sizeof(*tasks));
+		if (!tasks) {
+			pthread_mutex_unlock(&queue->lock);
+			return -1;
+		}
+
+		for (i = 0; i < queue->count; i++)
+			tasks[i] = queue->tasks[(queue->head + i) % queue->size];
+
+		free(queue->tasks);
+		queue->tasks = tasks;
+		queue->size = size;
+		queue->head = 0;
+	}
+
+	queue->tasks[(queue->head + queue->count++) % queue->size] = *task;
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return 0;
+}
+
+/* The owner takes the newest task, thieves the oldest one */
+static bool queue_pop(struct pool_queue *queue, struct pool_task *task,
+		      bool steal)
+{
+	bool found = false;
+
+	pthread_mutex_lock(&queue->lock);
+
+	if (queue->count) {
+		if (steal) {
+			*task = queue->tasks[queue->head];
+			queue->head = (queue->head + 1) % queue->size;
+		} else {
+			*task = queue->tasks[(queue->head + queue->count - 1) %
+					     queue->size];
+		}
+		queue->count--;
+		found = true;
+	}
+
+	pthread_mutex_unlock(&queue->lock);
+
+	return found;
+}
+
+/* Run a task reserved by the caller, which holds the lock of the pool */
+static void pool_run(struct pool_worker *self)
+{
+	struct pool *pool = self->pool;
+	struct pool_task task;
+	unsigned int i;
+
+	pool->queued--;
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; !queue_pop(&self->queue, &task, false); i++)
+		if (queue_pop(&pool->workers[i % pool->nworkers].queue, &task,
+			      true))
+			break;
+
+	task.run(task.arg);
+
+	pthread_mutex_lock(&pool->lock);
+	if (!--pool->pending)
+		pthread_cond_broadcast(&pool->idle);
+	pthread_cond_broadcast(&pool->done);
+}
+
+static void *pool_work(void *data)
+{
+	struct pool_worker *self = data;
+	struct pool *pool = self->pool;
+
+	pool_self = self;
+
+	pthread_mutex_lock(&pool->lock);
+	for (;;) {
+		while (!pool->queued && !pool->stop)
+			pthread_cond_wait(&pool->work, &pool->lock);
+		if (!pool->queued)
+			break;
+
+		pool_run(self);
+	}
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+struct pool *pool_create(unsigned int nworkers)
+{
+	struct pool *pool;
+	unsigned int i;
+
+	pool = calloc(1, sizeof(*pool));
+	if (!pool)
+		return NULL;
+
+	pool->workers = calloc(nworkers, sizeof(*pool->workers));
+	if (!pool->workers) {
+		free(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->idle, NULL);
+	pthread_cond_init(&pool->done, NULL);
+
+	for (i = 0; i < nworkers; i++) {
+		pool->workers[i].pool = pool;
+		pthread_mutex_init(&pool->workers[i].queue.lock, NULL);
+		if (pthread_create(&pool->workers[i].thread, NULL, pool_work,
+				   &pool->workers[i])) {
+			fprintf(stderr, "Cannot start the worker threads\n");
+			break;
+		}
+		pool->nworkers++;
+	}
+
+	if (!pool->nworkers) {
+		pool_destroy(pool);
+		return NULL;
+	}
+
+	return pool;
+}
+
+/* Let the workers finish the queued tasks, then stop them */
+void pool_destroy(struct pool *pool)
+{
+	unsigned int i;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->stop = true;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (i = 0; i < pool->nworkers; i++)
+		pthread_join(pool->workers[i].thread, NULL);
+
+	for (i = 0; i < pool->nworkers; i++)
+		free(pool->workers[i].queue.tasks);
+
+	free(pool->workers);
+	free(pool);
+}
+
+int pool_submit(struct pool *pool, void (*run)(void *arg), void *arg)
+{
+	struct pool_task task = {
+		.run = run,
+		.arg = arg,
+	};
+	struct pool_worker *worker = pool_self;
+
+	if (!worker || worker->pool != pool) {
+		pthread_mutex_lock(&pool->lock);
+		worker = &pool->workers[pool->next++ % pool->nworkers];
+		pthread_mutex_unlock(&pool->lock);
+	}
+
+	if (queue_push(&worker->queue, &task))
+		return -1;
+
+	pthread_mutex_lock(&pool->lock);
+	pool->queued++;
+	pool->pending++;
+	pthread_cond_signal(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	return 0;
+}
+
+void pool_wait(struct pool *pool)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (pool->pending)
+		pthread_cond_wait(&pool->idle, &pool->lock);
+	pthread_mutex_unlock(&pool->lock);
+}
+
+/* A worker waiting for its subtasks runs queued tasks meanwhile, so that
+ * the pool never ends up with all its workers waiting.
+ */
+void pool_help(struct pool *pool, atomic_uint *left)
+{
+	struct pool_worker *self = pool_self;
+
+	pthread_mutex_lock(&pool->lock);
+	while (atomic_load(left)) {
+		if (pool->queued && self && self->pool == pool)
+			pool_run(self);
+		else
+			pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pthread_mutex_unlock(&pool->lock);
+}
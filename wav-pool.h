@@ -0,0 +1,58 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2023 Bootlin
+ * Author: Miquel Raynal <miquel.raynal@bootlin.com>
+ */
+
+#include <stdbool.h>
+#include <stdatomic.h>
+#include <pthread.h>
+
+/*
+ * Work-stealing thread pool. Each worker owns a queue of tasks: tasks
+ * submitted by a worker go to its own queue and are run newest first, while
+ * idle workers steal the oldest tasks of the others. Tasks submitted from
+ * outside the pool are spread over the queues. pool_wait() returns once all
+ * the submitted tasks, including the ones they submitted, are done.
+ * pool_help() waits for a counter of subtasks to drop to zero, decremented
+ * by the subtasks themselves.
+ */
+
+struct pool_task {
+	void (*run)(void *arg);
+	void *arg;
+};
+
+struct pool_queue {
+	pthread_mutex_t lock;
+	struct pool_task *tasks;
+	unsigned int size;
+	unsigned int head;
+	unsigned int count;
+};
+
+struct pool_worker {
+	struct pool *pool;
+	pthread_t thread;
+	struct pool_queue queue;
+};
+
+struct pool {
+	struct pool_worker *workers;
+	unsigned int nworkers;
+	unsigned int next;
+	/* Tasks queued and not yet picked, tasks not yet done, any task done */
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t idle;
+	pthread_cond_t done;
+	unsigned int queued;
+	unsigned int pending;
+	bool stop;
+};
+
+struct pool *pool_create(unsigned int nworkers);
+void pool_destroy(struct pool *pool);
+int pool_submit(struct pool *pool, void (*run)(void *arg), void *arg);
+void pool_wait(struct pool *pool);
+void pool_help(struct pool *pool, atomic_uint *left);
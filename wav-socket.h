@@ -0,0 +1,20 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2023 Bootlin
+ * Author: Miquel Raynal <miquel.raynal@bootlin.com>
+ */
+
+#include <stddef.h>
+
+/*
+ * Unix stream sockets between the analyzer daemon and its clients. Writes
+ * never raise SIGPIPE, a peer which went away is reported as an error.
+ * socket_send_fd() sends a single byte carrying a descriptor, if any, which
+ * socket_recv_fd() returns, or -1.
+ */
+
+int socket_listen(const char *path);
+int socket_connect(const char *path);
+int socket_write(int fd, const void *buf, size_t len);
+int socket_send_fd(int sock, int fd);
+int socket_recv_fd(int sock, int *fd);
@@ -0,0 +1,524 @@
+// SPDX-License-Identifier: GPL-2.0+
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/perf_event.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+
+#include "wav-lib.h"
+#include "wav-stats.h"
+
+#define TRACE_MIN_EVENTS 1024
+#define TRACE_MAX_EVENTS (1 << 20)
+
+struct trace_event {
+	uint64_t start;
+	uint64_t end;
+	unsigned int stage;
+};
+
+/* Events of a thread, appended by this thread only */
+struct trace_buffer {
+	struct trace_buffer *next;
+	unsigned int tid;
+	struct trace_event *events;
+	unsigned int nevents;
+	unsigned int size;
+	unsigned int dropped;
+};
+
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct trace_buffer *trace_buffers;
+static unsigned int trace_nthreads;
+static _Thread_local struct trace_buffer *trace_self;
+
+#define PERF_MARKS 8
+
+static const struct {
+	const char *name;
+	uint64_t config;
+} perf_events[STATS_NEVENTS] = {
+	[STATS_CYCLES] = { "cycles", PERF_COUNT_HW_CPU_CYCLES },
+	[STATS_INSTRUCTIONS] = { "instructions", PERF_COUNT_HW_INSTRUCTIONS },
+	[STATS_CACHE_MISSES] = { "cache-misses", PERF_COUNT_HW_CACHE_MISSES },
+	[STATS_BRANCH_MISSES] = { "branch-misses", PERF_COUNT_HW_BRANCH_MISSES },
+};
+
+/* Values of the counters of a thread when a stage started */
+struct perf_mark {
+	uint64_t start;
+	uint64_t enabled;
+	uint64_t running;
+	uint64_t values[STATS_NEVENTS];
+};
+
+/* Counters of a thread, read at once as a group. The last stages started are
+ * kept in a ring, so nested or abandoned stages find their own values.
+ */
+struct perf_group {
+	struct perf_group *next;
+	int fds[STATS_NEVENTS];
+	int pos[STATS_NEVENTS];
+	unsigned int nfds;
+	struct perf_mark marks[PERF_MARKS];
+	unsigned int next_mark;
+};
+
+/* The groups of a run are closed by stats_stop(), a new run opens new ones */
+static pthread_mutex_t perf_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct perf_group *perf_groups;
+static atomic_uint perf_run;
+static atomic_int perf_error;
+static atomic_uint perf_missing;
+static _Thread_local struct perf_group *perf_self;
+static _Thread_local unsigned int perf_self_run;
+
+static uint64_t stats_clock(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+int stats_parse(const char *arg, enum stats_format *format)
+{
+	if (!arg || !strcmp(arg, "text"))
+		*format = STATS_TEXT;
+	else if (!strcmp(arg, "json"))
+		*format = STATS_JSON;
+	else
+		return -1;
+
+	return 0;
+}
+
+/* The buffer of a thread is registered on its first event */
+static void trace_record(uint64_t start, uint64_t end, unsigned int stage)
+{
+	struct trace_buffer *buf = trace_self;
+	struct trace_event *events;
+	unsigned int size;
+
+	if (!buf) {
+		buf = calloc(1, sizeof(*buf));
+		if (!buf)
+			return;
+
+		pthread_mutex_lock(&trace_lock);
+		buf->tid = ++trace_nthreads;
+		buf->next = trace_buffers;
+		trace_buffers = buf;
+		pthread_mutex_unlock(&trace_lock);
+		trace_self = buf;
+	}
+
+	if (buf->nevents == buf->size) {
+		size = buf->size ? 2 * buf->size : TRACE_MIN_EVENTS;
+		events = size <= TRACE_MAX_EVENTS ?
+			 realloc(buf->events, size * sizeof(*events)) : NULL;
+		if (!events) {
+			buf->dropped++;
+			return;
+		}
+
+		buf->events = events;
+		buf->size = size;
+	}
+
+	buf->events[buf->nevents].start = start;
+	buf->events[buf->nevents].end = end;
+	buf->events[buf->nevents++].stage = stage;
+}
+
+static int perf_open(uint64_t config, int group)
+{
+	struct perf_event_attr attr = {
+		.size = sizeof(attr),
+		.type = PERF_TYPE_HARDWARE,
+		.config = config,
+		.read_format = PERF_FORMAT_GROUP |
+			       PERF_FORMAT_TOTAL_TIME_ENABLED |
+			       PERF_FORMAT_TOTAL_TIME_RUNNING,
+		.exclude_kernel = 1,
+		.exclude_hv = 1,
+	};
+
+	return syscall(SYS_perf_event_open, &attr, 0, -1, group,
+		       PERF_FLAG_FD_CLOEXEC);
+}
+
+/* The group of a thread is opened on its first stage, without any counter if
+ * the host provides none.
+ */
+static struct perf_group *perf_get(void)
+{
+	struct perf_group *group;
+	unsigned int run = atomic_load(&perf_run);
+	int fd, e;
+
+	if (perf_self_run == run)
+		return perf_self;
+
+	group = calloc(1, sizeof(*group));
+	if (!group)
+		return NULL;
+
+	for (e = 0; e < STATS_NEVENTS; e++) {
+		fd = perf_open(perf_events[e].config,
+			       group->nfds ? group->fds[0] : -1);
+		group->pos[e] = -1;
+		if (fd < 0) {
+			atomic_fetch_or(&perf_missing, 1U << e);
+			if (!group->nfds)
+				atomic_store(&perf_error, errno);
+			continue;
+		}
+
+		group->pos[e] = group->nfds;
+		group->fds[group->nfds++] = fd;
+	}
+
+	pthread_mutex_lock(&perf_lock);
+	group->next = perf_groups;
+	perf_groups = group;
+	pthread_mutex_unlock(&perf_lock);
+	perf_self = group;
+	perf_self_run = run;
+
+	return group;
+}
+
+static int perf_read(struct perf_group *group, struct perf_mark *mark)
+{
+	/* Number of counters, times enabled and running, then the values */
+	uint64_t buf[3 + STATS_NEVENTS];
+	ssize_t len = (3 + group->nfds) * sizeof(uint64_t);
+	int e;
+
+	if (!group->nfds || read(group->fds[0], buf, sizeof(buf)) != len)
+		return -1;
+
+	mark->enabled = buf[1];
+	mark->running = buf[2];
+	for (e = 0; e < STATS_NEVENTS; e++)
+		if (group->pos[e] >= 0)
+			mark->values[e] = buf[3 + group->pos[e]];
+
+	return 0;
+}
+
+static void perf_mark(uint64_t start)
+{
+	struct perf_group *group = perf_get();
+	struct perf_mark *mark;
+
+	if (!group || !group->nfds)
+		return;
+
+	mark = &group->marks[group->next_mark++ % PERF_MARKS];
+	if (perf_read(group, mark))
+		mark->start = 0;
+	else
+		mark->start = start;
+}
+
+/* Add the events since the start of a stage, scaled if the counters were
+ * multiplexed with other users.
+ */
+static void perf_stage(struct stats_entry *stage, uint64_t start)
+{
+	struct perf_group *group = perf_get();
+	const struct perf_mark *mark = NULL;
+	struct perf_mark now;
+	double scale = 1;
+	unsigned int i;
+	int e;
+
+	if (!group || !group->nfds || !start)
+		return;
+
+	for (i = 1; i <= PERF_MARKS; i++) {
+		mark = &group->marks[(group->next_mark - i) % PERF_MARKS];
+		if (mark->start == start)
+			break;
+	}
+
+	if (i > PERF_MARKS || perf_read(group, &now) ||
+	    now.running == mark->running)
+		return;
+
+	if (now.enabled - mark->enabled != now.running - mark->running)
+		scale = (double)(now.enabled - mark->enabled) /
+			(now.running - mark->running);
+
+	for (e = 0; e < STATS_NEVENTS; e++)
+		if (group->pos[e] >= 0)
+			atomic_fetch_add_explicit(&stage->events[e],
+						  (now.values[e] - mark->values[e]) * scale,
+						  memory_order_relaxed);
+}
+
+static void perf_close(void)
+{
+	struct perf_group *group, *next;
+	unsigned int i;
+
+	pthread_mutex_lock(&perf_lock);
+	for (group = perf_groups; group; group = next) {
+		next = group->next;
+		for (i = 0; i < group->nfds; i++)
+			close(group->fds[i]);
+		free(group);
+	}
+	perf_groups = NULL;
+	pthread_mutex_unlock(&perf_lock);
+}
+
+/* Reset the stages and counters and start the wall clock */
+void stats_start(struct stats *stats, enum stats_format format, bool trace,
+		 bool perf)
+{
+	unsigned int i, e;
+
+	for (i = 0; i < stats->nstages; i++) {
+		atomic_store(&stats->stages[i].ns, 0);
+		atomic_store(&stats->stages[i].count, 0);
+		for (e = 0; e < STATS_NEVENTS; e++)
+			atomic_store(&stats->stages[i].events[e], 0);
+	}
+
+	for (i = 0; i < stats->ncounters; i++)
+		atomic_store(&stats->counters[i].count, 0);
+
+	/* The counters are reported with the stage timings */
+	if (perf) {
+		atomic_fetch_add(&perf_run, 1);
+		atomic_store(&perf_error, 0);
+		atomic_store(&perf_missing, 0);
+		if (format == STATS_OFF)
+			format = STATS_TEXT;
+	}
+
+	stats->format = format;
+	stats->trace = trace;
+	stats->perf = perf;
+	stats->enabled = format != STATS_OFF || trace;
+	stats->start = stats_now(stats);
+}
+
+void stats_stop(struct stats *stats)
+{
+	if (stats->perf)
+		perf_close();
+
+	stats->enabled = false;
+	stats->format = STATS_OFF;
+	stats->trace = false;
+	stats->perf = false;
+}
+
+uint64_t stats_now(const struct stats *stats)
+{
+	uint64_t now;
+
+	if (!stats->enabled)
+		return 0;
+
+	now = stats_clock();
+	if (stats->perf)
+		perf_mark(now);
+
+	return now;
+}
+
+/* Account the time elapsed since 'start' to a stage */
+void stats_stage(struct stats *stats, unsigned int stage, uint64_t start)
+{
+	uint64_t now;
+
+	if (!stats->enabled)
+		return;
+
+	now = stats_clock();
+	if (stats->trace)
+		trace_record(start, now, stage);
+
+	if (stats->format == STATS_OFF)
+		return;
+
+	atomic_fetch_add_explicit(&stats->stages[stage].ns, now - start,
+				  memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats->stages[stage].count, 1,
+				  memory_order_relaxed);
+
+	if (stats->perf)
+		perf_stage(&stats->stages[stage], start);
+}
+
+void stats_count(struct stats *stats, unsigned int counter, uint64_t n)
+{
+	if (stats->format == STATS_OFF)
+		return;
+
+	atomic_fetch_add_explicit(&stats->counters[counter].count, n,
+				  memory_order_relaxed);
+}
+
+static void perf_print(const struct stats_entry *stage, FILE *fd, bool json)
+{
+	unsigned int missing = atomic_load(&perf_missing);
+	unsigned long long cycles, instructions;
+	int e;
+
+	for (e = 0; e < STATS_NEVENTS; e++) {
+		if (missing & (1U << e))
+			continue;
+
+		if (json)
+			fprintf(fd, ", \"%s\": %llu", perf_events[e].name,
+				atomic_load(&stage->events[e]));
+		else
+			fprintf(fd, ", %llu %s", atomic_load(&stage->events[e]),
+				perf_events[e].name);
+	}
+
+	cycles = atomic_load(&stage->events[STATS_CYCLES]);
+	instructions = atomic_load(&stage->events[STATS_INSTRUCTIONS]);
+	if (!(missing & (1U << STATS_CYCLES | 1U << STATS_INSTRUCTIONS)) &&
+	    cycles)
+		fprintf(fd, json ? ", \"ipc\": %.2f" : ", %.2f IPC",
+			(double)instructions / cycles);
+}
+
+/* Summarize the stages and counters, with the throughput in MB/s of the
+ * 'bytes' counter and in units per second of the 'items' counter.
+ */
+void stats_print(const struct stats *stats, FILE *fd, const char *tool,
+		 unsigned int bytes, unsigned int items)
+{
+	const char *unit = stats->counters[items].name;
+	double wall, mbps, ips;
+	struct rusage usage;
+	unsigned int i;
+	int error = 0;
+
+	if (stats->format == STATS_OFF)
+		return;
+
+	/* No counter could be opened at all */
+	if (stats->perf && atomic_load(&perf_missing) == (1U << STATS_NEVENTS) - 1)
+		error = atomic_load(&perf_error);
+
+	if (getrusage(RUSAGE_SELF, &usage))
+		usage.ru_maxrss = 0;
+
+	wall = (stats_clock() - stats->start) / 1e9;
+	mbps = atomic_load(&stats->counters[bytes].count) / 1e6 / wall;
+	ips = atomic_load(&stats->counters[items].count) / wall;
+
+	if (stats->format == STATS_JSON) {
+		fprintf(fd, "{\"tool\": \"%s\", \"wall_ms\": %.3f, \"stages\": {",
+			tool, wall * 1e3);
+		for (i = 0; i < stats->nstages; i++) {
+			fprintf(fd, "%s\"%s\": {\"ms\": %.3f, \"calls\": %llu",
+				i ? ", " : "", stats->stages[i].name,
+				atomic_load(&stats->stages[i].ns) / 1e6,
+				atomic_load(&stats->stages[i].count));
+			if (stats->perf)
+				perf_print(&stats->stages[i], fd, true);
+			fprintf(fd, "}");
+		}
+		fprintf(fd, "}, \"counters\": {");
+		for (i = 0; i < stats->ncounters; i++)
+			fprintf(fd, "%s\"%s\": %llu", i ? ", " : "",
+				stats->counters[i].name,
+				atomic_load(&stats->counters[i].count));
+		fprintf(fd, "}, \"mb_per_s\": %.3f, \"%s_per_s\": %.3f, \"heap_peak_bytes\": %zu, \"max_rss_kb\": %ld",
+			mbps, unit, ips, mem_peak(), usage.ru_maxrss);
+		if (error)
+			fprintf(fd, ", \"perf_error\": \"%s\"", strerror(error));
+		fprintf(fd, "}\n");
+		return;
+	}
+
+	if (error)
+		fprintf(fd, "Performance counters unavailable: %s\n",
+			strerror(error));
+	fprintf(fd, "Statistics (stage times summed over the threads):\n");
+	for (i = 0; i < stats->nstages; i++) {
+		fprintf(fd, "* %s: %.3f ms, %llu calls", stats->stages[i].name,
+			atomic_load(&stats->stages[i].ns) / 1e6,
+			atomic_load(&stats->stages[i].count));
+		if (stats->perf)
+			perf_print(&stats->stages[i], fd, false);
+		fprintf(fd, "\n");
+	}
+	for (i = 0; i < stats->ncounters; i++)
+		fprintf(fd, "* %s: %llu\n", stats->counters[i].name,
+			atomic_load(&stats->counters[i].count));
+	fprintf(fd, "* Wall time: %.3f ms, %.1f MB/s, %.1f %s/s\n\n",
+		wall * 1e3, mbps, ips, unit);
+}
+
+/* Complete events, in microseconds since the start of the run, one track per
+ * thread. The buffers are freed.
+ */
+int stats_trace_dump(const struct stats *stats, const char *path)
+{
+	struct trace_buffer *buf, *next;
+	const struct trace_event *ev;
+	unsigned int i, dropped = 0;
+	bool first = true;
+	int pid = getpid();
+	FILE *f;
+
+	f = fopen(path, "w");
+	if (!f) {
+		fprintf(diag(), "Cannot create %s\n", path);
+		return -1;
+	}
+
+	fprintf(f, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [");
+	for (buf = trace_buffers; buf; buf = buf->next) {
+		fprintf(f, "%s\n{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": %d, \"tid\": %u, \"args\": {\"name\": \"thread %u\"}}",
+			first ? "" : ",", pid, buf->tid, buf->tid);
+		first = false;
+
+		for (i = 0; i < buf->nevents; i++) {
+			ev = &buf->events[i];
+			fprintf(f, ",\n{\"name\": \"%s\", \"ph\": \"X\", \"pid\": %d, \"tid\": %u, \"ts\": %.3f, \"dur\": %.3f}",
+				stats->stages[ev->stage].name, pid, buf->tid,
+				(ev->start - stats->start) / 1e3,
+				(ev->end - ev->start) / 1e3);
+		}
+
+		dropped += buf->dropped;
+	}
+	fprintf(f, "\n]}\n");
+
+	for (buf = trace_buffers; buf; buf = next) {
+		next = buf->next;
+		free(buf->events);
+		free(buf);
+	}
+	trace_buffers = NULL;
+	trace_nthreads = 0;
+	trace_self = NULL;
+
+	if (dropped)
+		fprintf(diag(), "Trace: %u events dropped\n", dropped);
+
+	if (fclose(f)) {
+		fprintf(diag(), "Cannot write %s\n", path);
+		return -1;
+	}
+
+	return 0;
+}
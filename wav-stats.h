@@ -0,0 +1,73 @@
+// SPDX-License-Identifier: GPL-2.0+
+/*
+ * Copyright (C) 2023 Bootlin
+ * Author: Miquel Raynal <miquel.raynal@bootlin.com>
+ */
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+/*
+ * Per-stage timers and counters of the tools, printed with --stats. Each tool
+ * describes its stages and counters in tables indexed by its own enums. They
+ * are accumulated from any thread: the time of a stage is the sum of the
+ * times spent in it by all the threads. While disabled, stats_now() returns
+ * 0 without reading the clock and nothing is accumulated.
+ *
+ * With --trace, each stage run is also recorded as an event in a buffer
+ * owned by the calling thread, without locking. stats_trace_dump() writes
+ * them all in the Chrome trace event format, once the threads are done.
+ *
+ * With --perf-counters, each thread also opens its own hardware counters on
+ * its first stage, counting in user space only, and each stage accumulates
+ * the events of the threads running it. Counters the host does not provide
+ * (virtual machines, perf_event_paranoid) are reported as unavailable, the
+ * timings remain.
+ */
+
+enum stats_event {
+	STATS_CYCLES,
+	STATS_INSTRUCTIONS,
+	STATS_CACHE_MISSES,
+	STATS_BRANCH_MISSES,
+	STATS_NEVENTS,
+};
+
+enum stats_format {
+	STATS_OFF,
+	STATS_TEXT,
+	STATS_JSON,
+};
+
+struct stats_entry {
+	const char *name;
+	atomic_ullong ns;
+	atomic_ullong count;
+	/* Hardware events of a stage */
+	atomic_ullong events[STATS_NEVENTS];
+};
+
+struct stats {
+	bool enabled;
+	enum stats_format format;
+	bool trace;
+	bool perf;
+	struct stats_entry *stages;
+	unsigned int nstages;
+	struct stats_entry *counters;
+	unsigned int ncounters;
+	uint64_t start;
+};
+
+int stats_parse(const char *arg, enum stats_format *format);
+void stats_start(struct stats *stats, enum stats_format format, bool trace,
+		 bool perf);
+void stats_stop(struct stats *stats);
+uint64_t stats_now(const struct stats *stats);
+void stats_stage(struct stats *stats, unsigned int stage, uint64_t start);
+void stats_count(struct stats *stats, unsigned int counter, uint64_t n);
+void stats_print(const struct stats *stats, FILE *fd, const char *tool,
+		 unsigned int bytes, unsigned int items);
+int stats_trace_dump(const struct stats *stats, const char *path);